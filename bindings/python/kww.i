@@ -29,7 +29,9 @@
  *
  */
 
-%module kww
+// threads="1": release the GIL during each call, so that calls from
+// several Python threads run concurrently; the library is thread-safe
+%module(threads="1") kww
 %{
 extern double kwwc( const double w, const double beta );
 extern double kwws( const double w, const double beta );
@@ -40,3 +42,23 @@ extern double kwwc( const double w, const double beta );
 extern double kwws( const double w, const double beta );
 extern double kwwp( const double w, const double beta );
 
+%pythoncode %{
+# NumPy ufuncs with broadcasting, out= and where=, replacing the scalar
+# functions above, if the extension _kww_ufunc has been built
+try:
+    if __package__ or "." in __name__:
+        from ._kww_ufunc import kwwc, kwws, kwwp
+    else:
+        from _kww_ufunc import kwwc, kwws, kwwp
+except ImportError:
+    pass
+
+# Fit model with analytic Jacobian, if the extension kww_native has been built
+try:
+    if __package__ or "." in __name__:
+        from .kww_native import Model
+    else:
+        from kww_native import Model
+except ImportError:
+    pass
+%}
@@ -71,4 +71,23 @@ def kwws(w, beta):
 def kwwp(w, beta):
     return _kww.kwwp(w, beta)
 
+# NumPy ufuncs with broadcasting, out= and where=, replacing the scalar
+# functions above, if the extension _kww_ufunc has been built
+try:
+    if __package__ or "." in __name__:
+        from ._kww_ufunc import kwwc, kwws, kwwp
+    else:
+        from _kww_ufunc import kwwc, kwws, kwwp
+except ImportError:
+    pass
+
+# Fit model with analytic Jacobian, if the extension kww_native has been built
+try:
+    if __package__ or "." in __name__:
+        from .kww_native import Model
+    else:
+        from kww_native import Model
+except ImportError:
+    pass
+
 
@@ -0,0 +1,115 @@
+# kww_jax.py:
+#   kwwc for JAX on CPU, through XLA custom calls into the kww library,
+#   with a batching rule for vmap, and a custom JVP from the derivatives
+#   of kwwc by omega and beta, for grad and jvp.
+#
+# Copyright:
+#   (C) 2023 Joachim Wuttke
+#
+# Licence:
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published
+#   by the Free Software Foundation; either version 3 of the License, or
+#   (at your option) any later version. Alternative licenses can be
+#   obtained through written agreement from the author.
+#
+# Website:
+#   https://jugit.fz-juelich.de/mlz/kww
+
+"""kwwc for JAX on CPU.
+
+kwwc(omega, beta) is computed by the kww library in XLA custom calls, so
+that it can be used under jit, vmap, grad, jvp. omega and beta are broadcast
+against each other. The computation is done in double precision. The result
+is float64 if the arguments promote to float64, which needs jax_enable_x64,
+and float32 otherwise, also for float16 and bfloat16 arguments. Where beta
+is out of range or kwwc fails, the result is NaN.
+
+Derivatives are of first order only. Requires JAX 0.5 or later, and the
+module kww_native.
+"""
+
+import numpy as np
+import jax
+import jax.numpy as jnp
+
+if __package__ or "." in __name__:
+    from . import kww_native
+else:
+    import kww_native
+
+for _name, _target in kww_native.xla_targets.items():
+    jax.ffi.register_ffi_target("kww_" + _name, _target, platform="cpu",
+                                api_version=0)
+
+
+def _custom_call(name, nout, omega, beta):
+    """Calls target name on omega, beta of equal shape and floating type;
+    returns nout arrays of that shape and type."""
+    if omega.size >= 2**31:
+        raise ValueError("kww_jax: too many points for one call")
+    # the targets read and write elements of exactly this size
+    if omega.dtype not in (jnp.float32, jnp.float64) \
+       or beta.dtype != omega.dtype:
+        raise TypeError("kww_jax: need float32 or float64 arguments")
+    suffix = "_f64" if omega.dtype == jnp.float64 else "_f32"
+    shape = jax.ShapeDtypeStruct(omega.shape, omega.dtype)
+    # the original custom call API passes no shapes: the first operand
+    # is the number of points
+    call = jax.ffi.ffi_call("kww_" + name + suffix,
+                            (shape,) * nout if nout > 1 else shape,
+                            custom_call_api_version=1)
+    return call(np.int32(omega.size), omega, beta)
+
+
+def _batched(axis_size, in_batched, *args):
+    """Adds the batch axis to the arguments that lack it."""
+    return [x if b else jnp.broadcast_to(x, (axis_size,) + x.shape)
+            for x, b in zip(args, in_batched)]
+
+
+@jax.custom_batching.custom_vmap
+def _kwwc(omega, beta):
+    return _custom_call("kwwc", 1, omega, beta)
+
+
+@_kwwc.def_vmap
+def _kwwc_vmap(axis_size, in_batched, omega, beta):
+    # elementwise: the batch is evaluated in one call
+    return _kwwc(*_batched(axis_size, in_batched, omega, beta)), True
+
+
+@jax.custom_batching.custom_vmap
+def _kwwc_deriv(omega, beta):
+    return _custom_call("kwwc_deriv", 3, omega, beta)
+
+
+@_kwwc_deriv.def_vmap
+def _kwwc_deriv_vmap(axis_size, in_batched, omega, beta):
+    out = _kwwc_deriv(*_batched(axis_size, in_batched, omega, beta))
+    return out, (True,) * 3
+
+
+def _prepare(omega, beta):
+    dtype = jnp.result_type(float, omega, beta)
+    if not jnp.issubdtype(dtype, jnp.floating):
+        raise TypeError("kww_jax: omega and beta must be real")
+    if dtype != jnp.float64:
+        dtype = jnp.float32
+    return jnp.broadcast_arrays(jnp.asarray(omega, dtype),
+                                jnp.asarray(beta, dtype))
+
+
+@jax.custom_jvp
+def kwwc(omega, beta):
+    """Integral from 0 to infinity dt cos(omega*t) exp(-t^beta)."""
+    return _kwwc(*_prepare(omega, beta))
+
+
+@kwwc.defjvp
+def _kwwc_jvp(primals, tangents):
+    c, dw, db = _kwwc_deriv(*_prepare(*primals))
+    # integer arguments have tangents of type float0, which do not multiply
+    domega, dbeta = (jnp.zeros((), c.dtype) if t.dtype == jax.dtypes.float0
+                     else t for t in tangents)
+    return c, (dw * domega + db * dbeta).astype(c.dtype)
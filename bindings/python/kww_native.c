@@ -0,0 +1,906 @@
+/* kww_native.c:
+ *   Python extension module kww_native, built with CMake against the kww
+ *   library. Array arguments are taken through the buffer protocol, without
+ *   copying if they are C-contiguous float64; results can be written into
+ *   caller-provided arrays. Exposes plans, complex evaluation, and status
+ *   arrays, a fit model with analytic Jacobian, and XLA custom call targets
+ *   for kww_jax. The GIL is released during computations.
+ *
+ * Copyright:
+ *   (C) 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+#include <stdint.h>
+#include <string.h>
+#include "kww.h"
+
+/* Besides KWW_C, KWW_S, KWW_P: kwwc and kwws at once */
+#define KIND_COMPLEX 3
+
+/*****************************************************************************/
+/*  Evaluation                                                               */
+/*****************************************************************************/
+
+/* What to compute: kind, with beta from plan, or from beta if plan is NULL */
+typedef struct {
+    int kind;
+    const kww_plan* plan;
+    double beta;
+} target;
+
+typedef size_t array_fn( const double* w, const size_t n, const double beta,
+                         double* out, int* status );
+typedef size_t plan_array_fn( const kww_plan* plan, const double* w,
+                              const size_t n, double* out, int* status );
+
+static array_fn* const array_e[3] = {
+    kwwc_array_e, kwws_array_e, kwwp_array_e };
+static plan_array_fn* const plan_array_e[3] = {
+    kwwc_plan_array_e, kwws_plan_array_e, kwwp_plan_array_e };
+
+/* Computes out0 (and out1 for KIND_COMPLEX) at w[0..n-1]; never fails, but
+   sets NaN and status[i] for failed points. Needs no GIL. */
+static void eval( const target* T, const double* w, const size_t n,
+                  double* out0, double* out1, int* status )
+{
+    if ( T->plan ) {
+        if ( T->kind==KIND_COMPLEX )
+            kww_complex_plan_array_e( T->plan, w, n, out0, out1, status );
+        else
+            plan_array_e[T->kind]( T->plan, w, n, out0, status );
+    } else {
+        if ( T->kind==KIND_COMPLEX )
+            kww_complex_array_e( w, n, T->beta, out0, out1, status );
+        else
+            array_e[T->kind]( w, n, T->beta, out0, status );
+    }
+}
+
+typedef int scalar_fn( const double w, const double beta, double* res );
+typedef int plan_scalar_fn( const kww_plan* plan, const double w,
+                            double* res );
+
+static scalar_fn* const scalar_e[3] = { kwwc_e, kwws_e, kwwp_e };
+static plan_scalar_fn* const plan_scalar_e[3] = {
+    kwwc_plan_e, kwws_plan_e, kwwp_plan_e };
+
+/* Same as eval for one point, without the setup of an array call */
+static void eval_one( const target* T, const double w, double* res )
+{
+    if ( T->kind==KIND_COMPLEX ) {
+        if ( T->plan )
+            kww_complex_plan_array_e( T->plan, &w, 1, &res[0], &res[1],
+                                      NULL );
+        else
+            kww_complex_e( w, T->beta, &res[0], &res[1] );
+    } else if ( T->plan )
+        plan_scalar_e[T->kind]( T->plan, w, res );
+    else
+        scalar_e[T->kind]( w, T->beta, res );
+}
+
+/* Whether the buffer format describes the native type with code c */
+static int format_is( const Py_buffer* v, const char c )
+{
+    const char* f = v->format ? v->format : "B";
+    if ( *f=='@' || *f=='=' )
+        ++f;
+    return f[0]==c && !f[1];
+}
+
+/* Whether the bytes of buffer v overlap the data of array w, which is
+   C-contiguous */
+static int overlaps( const Py_buffer* v, PyArrayObject* w )
+{
+    const char* a = v->buf;
+    const char* b = PyArray_DATA( w );
+    return a<b+PyArray_NBYTES( w ) && b<a+v->len;
+}
+
+/* Gets a writable C-contiguous buffer of n items of type code c
+   (d: double, i: int) from obj; returns 0, or -1 with exception set. */
+static int get_out( PyObject* obj, const char* name, const char c,
+                    const Py_ssize_t n, Py_buffer* v )
+{
+    const Py_ssize_t size = c=='d' ? sizeof(double) : sizeof(int);
+    if ( PyObject_GetBuffer( obj, v, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS |
+                             PyBUF_FORMAT ) )
+        return -1;
+    if ( !format_is( v, c ) || v->itemsize!=size ) {
+        PyErr_Format( PyExc_TypeError, "%s must be of type %s", name,
+                      c=='d' ? "float64" : "int32" );
+        PyBuffer_Release( v );
+        return -1;
+    }
+    if ( v->len/size!=n ) {
+        PyErr_Format( PyExc_ValueError, "%s must have %zd elements",
+                      name, n );
+        PyBuffer_Release( v );
+        return -1;
+    }
+    return 0;
+}
+
+/* Evaluates T at omega, which is a number or an array-like. Results go to
+   out[0] (and out[1] for KIND_COMPLEX), which are newly allocated arrays of
+   the shape of omega where None; status codes go to status unless None.
+   Returns a float, an array, or a tuple of these for KIND_COMPLEX. */
+static PyObject* call( const target* T, PyObject* omega, PyObject** out,
+                       PyObject* status )
+{
+    const int nout = T->kind==KIND_COMPLEX ? 2 : 1;
+    PyArrayObject* w;
+    Py_buffer vout[2];
+    Py_buffer vstatus;
+    int nv = 0;
+    int has_status = status && status!=Py_None;
+    PyObject* res[2] = { NULL, NULL };
+    PyObject* ret = NULL;
+    Py_ssize_t n;
+
+    // fast path for scalars
+    if ( ( PyFloat_Check( omega ) || PyLong_Check( omega ) ) &&
+         ( !out[0] || out[0]==Py_None ) && !has_status ) {
+        const double x = PyFloat_AsDouble( omega );
+        double r[2];
+        if ( x==-1 && PyErr_Occurred() )
+            return NULL;
+        Py_BEGIN_ALLOW_THREADS
+        eval_one( T, x, r );
+        Py_END_ALLOW_THREADS
+        if ( nout==1 )
+            return PyFloat_FromDouble( r[0] );
+        return Py_BuildValue( "(dd)", r[0], r[1] );
+    }
+
+    // any buffer or sequence; copied only if not C-contiguous float64
+    if ( !( w = (PyArrayObject*)PyArray_FROM_OTF( omega, NPY_DOUBLE,
+                                                  NPY_ARRAY_IN_ARRAY ) ) )
+        return NULL;
+    n = PyArray_SIZE( w );
+    for ( int k=0; k<nout; ++k ) {
+        if ( out[k] && out[k]!=Py_None ) {
+            if ( get_out( out[k], k ? "im" : "out", 'd', n, &vout[k] ) )
+                goto done;
+            Py_INCREF( out[k] );
+            res[k] = out[k];
+        } else {
+            if ( !( res[k] = PyArray_SimpleNew( PyArray_NDIM( w ),
+                                                PyArray_DIMS( w ),
+                                                NPY_DOUBLE ) ) ||
+                 PyObject_GetBuffer( res[k], &vout[k], PyBUF_WRITABLE ) ) {
+                Py_CLEAR( res[k] );
+                goto done;
+            }
+        }
+        nv = k+1;
+    }
+    if ( has_status && get_out( status, "status", 'i', n, &vstatus ) )
+        goto done;
+    // the library reads omega after writing some results: copy omega if
+    // any output overlaps it, even partially, as with out=x[1:], omega=x
+    for ( int k=0; k<nout+has_status; ++k ) {
+        const Py_buffer* v = k<nout ? &vout[k] : &vstatus;
+        if ( n && overlaps( v, w ) ) {
+            PyArrayObject* c = (PyArrayObject*)PyArray_NewCopy( w,
+                                                                NPY_CORDER );
+            if ( !c ) {
+                if ( has_status )
+                    PyBuffer_Release( &vstatus );
+                goto done;
+            }
+            Py_DECREF( w );
+            w = c;
+            break;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    eval( T, (const double*)PyArray_DATA( w ), n, vout[0].buf,
+          nout>1 ? vout[1].buf : NULL, has_status ? vstatus.buf : NULL );
+    Py_END_ALLOW_THREADS
+
+    if ( has_status )
+        PyBuffer_Release( &vstatus );
+    if ( nout==1 ) {
+        ret = res[0];
+        res[0] = NULL;
+    } else {
+        ret = PyTuple_Pack( 2, res[0], res[1] );
+    }
+done:
+    for ( int k=0; k<nv; ++k )
+        PyBuffer_Release( &vout[k] );
+    Py_XDECREF( res[0] );
+    Py_XDECREF( res[1] );
+    Py_DECREF( w );
+    return ret;
+}
+
+/*****************************************************************************/
+/*  Module functions                                                         */
+/*****************************************************************************/
+
+static PyObject* kind_call( const int kind, PyObject* args, PyObject* kw )
+{
+    static char* kwlist[] = { "omega", "beta", "out", "status", NULL };
+    static char* kwlist_c[] = { "omega", "beta", "re", "im", "status", NULL };
+    PyObject* omega;
+    PyObject* out[2] = { NULL, NULL };
+    PyObject* status = NULL;
+    target T = { kind, NULL, 0 };
+    if ( !kw && PyTuple_GET_SIZE( args )==2 &&
+         PyFloat_CheckExact( PyTuple_GET_ITEM( args, 1 ) ) ) {
+        // common case kwwc(omega, beta), without the cost of parsing
+        omega = PyTuple_GET_ITEM( args, 0 );
+        T.beta = PyFloat_AS_DOUBLE( PyTuple_GET_ITEM( args, 1 ) );
+    } else if ( kind==KIND_COMPLEX ) {
+        if ( !PyArg_ParseTupleAndKeywords( args, kw, "Od|OOO:complex",
+                                           kwlist_c, &omega, &T.beta,
+                                           &out[0], &out[1], &status ) )
+            return NULL;
+    } else if ( !PyArg_ParseTupleAndKeywords( args, kw, "Od|OO", kwlist,
+                                              &omega, &T.beta, &out[0],
+                                              &status ) )
+        return NULL;
+    return call( &T, omega, out, status );
+}
+
+static PyObject* py_kwwc( PyObject* self, PyObject* args, PyObject* kw )
+{
+    return kind_call( KWW_C, args, kw );
+}
+
+static PyObject* py_kwws( PyObject* self, PyObject* args, PyObject* kw )
+{
+    return kind_call( KWW_S, args, kw );
+}
+
+static PyObject* py_kwwp( PyObject* self, PyObject* args, PyObject* kw )
+{
+    return kind_call( KWW_P, args, kw );
+}
+
+static PyObject* py_complex( PyObject* self, PyObject* args, PyObject* kw )
+{
+    return kind_call( KIND_COMPLEX, args, kw );
+}
+
+static PyObject* py_init( PyObject* self, PyObject* args, PyObject* kw )
+{
+    static char* kwlist[] = { "beta_min", "beta_max", "niter", NULL };
+    kww_init_options opt = { 0, 0, 0 };
+    int err;
+    if ( !PyArg_ParseTupleAndKeywords( args, kw, "|ddi:init", kwlist,
+                                       &opt.beta_min, &opt.beta_max,
+                                       &opt.niter ) )
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    err = kww_init( &opt );
+    Py_END_ALLOW_THREADS
+    if ( err==KWW_EDOM ) {
+        PyErr_SetString( PyExc_ValueError, "invalid beta range or niter" );
+        return NULL;
+    } else if ( err ) {
+        return PyErr_NoMemory();
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_finalize( PyObject* self, PyObject* noargs )
+{
+    kww_finalize();
+    Py_RETURN_NONE;
+}
+
+/*****************************************************************************/
+/*  Plan objects                                                             */
+/*****************************************************************************/
+
+typedef struct {
+    PyObject_HEAD
+    kww_plan* plan;
+} PlanObject;
+
+static PyObject* plan_new( PyTypeObject* type, PyObject* args, PyObject* kw )
+{
+    static char* kwlist[] = { "beta", NULL };
+    double beta;
+    PlanObject* self;
+    if ( !PyArg_ParseTupleAndKeywords( args, kw, "d:Plan", kwlist, &beta ) )
+        return NULL;
+    if ( !( self = (PlanObject*)type->tp_alloc( type, 0 ) ) )
+        return NULL;
+    if ( !( self->plan = kww_plan_create( beta ) ) ) {
+        Py_DECREF( self );
+        if ( beta>=0.1 && beta<=2.0 )
+            return PyErr_NoMemory();
+        PyErr_SetString( PyExc_ValueError, "beta out of range 0.1..2" );
+        return NULL;
+    }
+    return (PyObject*)self;
+}
+
+static void plan_dealloc( PlanObject* self )
+{
+    kww_plan_destroy( self->plan );
+    Py_TYPE( self )->tp_free( (PyObject*)self );
+}
+
+static PyObject* plan_call( PlanObject* self, const int kind, PyObject* args,
+                            PyObject* kw )
+{
+    static char* kwlist[] = { "omega", "out", "status", NULL };
+    static char* kwlist_c[] = { "omega", "re", "im", "status", NULL };
+    PyObject* omega;
+    PyObject* out[2] = { NULL, NULL };
+    PyObject* status = NULL;
+    target T = { kind, self->plan, 0 };
+    if ( !kw && PyTuple_GET_SIZE( args )==1 )
+        omega = PyTuple_GET_ITEM( args, 0 );
+    else if ( kind==KIND_COMPLEX ) {
+        if ( !PyArg_ParseTupleAndKeywords( args, kw, "O|OOO:complex",
+                                           kwlist_c, &omega, &out[0],
+                                           &out[1], &status ) )
+            return NULL;
+    } else if ( !PyArg_ParseTupleAndKeywords( args, kw, "O|OO", kwlist,
+                                              &omega, &out[0], &status ) )
+        return NULL;
+    return call( &T, omega, out, status );
+}
+
+static PyObject* plan_kwwc( PlanObject* self, PyObject* args, PyObject* kw )
+{
+    return plan_call( self, KWW_C, args, kw );
+}
+
+static PyObject* plan_kwws( PlanObject* self, PyObject* args, PyObject* kw )
+{
+    return plan_call( self, KWW_S, args, kw );
+}
+
+static PyObject* plan_kwwp( PlanObject* self, PyObject* args, PyObject* kw )
+{
+    return plan_call( self, KWW_P, args, kw );
+}
+
+static PyObject* plan_complex( PlanObject* self, PyObject* args, PyObject* kw )
+{
+    return plan_call( self, KIND_COMPLEX, args, kw );
+}
+
+static PyObject* plan_get_beta( PlanObject* self, void* closure )
+{
+    return PyFloat_FromDouble( kww_plan_beta( self->plan ) );
+}
+
+static PyObject* plan_get_tol( PlanObject* self, void* closure )
+{
+    return PyFloat_FromDouble( kww_plan_tol( self->plan ) );
+}
+
+static int plan_set_tol( PlanObject* self, PyObject* value, void* closure )
+{
+    double tol;
+    if ( !value ) {
+        PyErr_SetString( PyExc_AttributeError, "cannot delete tol" );
+        return -1;
+    }
+    tol = PyFloat_AsDouble( value );
+    if ( tol==-1 && PyErr_Occurred() )
+        return -1;
+    if ( kww_plan_set_tol( self->plan, tol ) ) {
+        PyErr_SetString( PyExc_ValueError,
+                         "tol out of range TOL_MIN..TOL_MAX" );
+        return -1;
+    }
+    return 0;
+}
+
+#define KW_METH(f) (PyCFunction)(void(*)(void))(f), METH_VARARGS | METH_KEYWORDS
+
+static PyMethodDef plan_methods[] = {
+    { "kwwc", KW_METH( plan_kwwc ),
+      "kwwc(omega, out=None, status=None)\n\nkwwc with beta of this plan." },
+    { "kwws", KW_METH( plan_kwws ),
+      "kwws(omega, out=None, status=None)\n\nkwws with beta of this plan." },
+    { "kwwp", KW_METH( plan_kwwp ),
+      "kwwp(omega, out=None, status=None)\n\nkwwp with beta of this plan." },
+    { "complex", KW_METH( plan_complex ),
+      "complex(omega, re=None, im=None, status=None)\n\n"
+      "(kwwc, kwws) with beta of this plan, computed together." },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyGetSetDef plan_getset[] = {
+    { "beta", (getter)plan_get_beta, NULL, "stretching exponent", NULL },
+    { "tol", (getter)plan_get_tol, (setter)plan_set_tol,
+      "relative tolerance, TOL_MIN (default) to TOL_MAX", NULL },
+    { NULL, NULL, NULL, NULL, NULL }
+};
+
+static PyTypeObject PlanType = {
+    PyVarObject_HEAD_INIT( NULL, 0 )
+    .tp_name = "kww_native.Plan",
+    .tp_basicsize = sizeof(PlanObject),
+    .tp_dealloc = (destructor)plan_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Plan(beta)\n\n"
+              "Series coefficients for one beta, computed once for many calls.",
+    .tp_methods = plan_methods,
+    .tp_getset = plan_getset,
+    .tp_new = plan_new,
+};
+
+/*****************************************************************************/
+/*  Fit model                                                                */
+/*****************************************************************************/
+
+/* Model A*tau*kwwc(omega*tau, beta) + bg at fixed omega, for least-squares
+   fits, with parameters p = (A, tau, beta, bg). */
+typedef struct {
+    PyObject_HEAD
+    Py_ssize_t n;
+    PyArrayObject* omega;  // copies of the arguments, C-contiguous float64
+    PyArrayObject* data;   // or NULL
+    PyArrayObject* sigma;  // or NULL
+    kww_plan* plan;        // for beta of the last evaluation, or NULL
+    double* buf;           // x = omega*tau, kwwc, d/dw, d/dbeta at x
+    double p[4];           // parameters of the contents of buf
+    int cached;            // whether buf holds derivatives for p
+    PyThread_type_lock lock; // guards plan, buf, p, cached
+} ModelObject;
+
+/* What model_run writes */
+#define MODEL_F     1      // model values
+#define MODEL_RESID 2      // (f-data)/sigma
+#define MODEL_JAC   4      // Jacobian by A, tau, beta, bg; divided by sigma
+#define MODEL_RAW   8      // with MODEL_JAC: not divided by sigma
+
+/* Copies obj into a new C-contiguous float64 array of n elements, or of
+   any size if n<0; returns NULL with exception set. */
+static PyArrayObject* model_array( PyObject* obj, const char* name,
+                                   const Py_ssize_t n )
+{
+    PyArrayObject* a = (PyArrayObject*)PyArray_FROM_OTF(
+        obj, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY | NPY_ARRAY_ENSURECOPY );
+    if ( a && n>=0 && PyArray_SIZE( a )!=n ) {
+        PyErr_Format( PyExc_ValueError, "%s must have %zd elements",
+                      name, n );
+        Py_CLEAR( a );
+    }
+    return a;
+}
+
+static PyObject* model_new( PyTypeObject* type, PyObject* args, PyObject* kw )
+{
+    static char* kwlist[] = { "omega", "data", "sigma", NULL };
+    PyObject* omega;
+    PyObject* data = Py_None;
+    PyObject* sigma = Py_None;
+    ModelObject* self;
+    if ( !PyArg_ParseTupleAndKeywords( args, kw, "O|OO:Model", kwlist,
+                                       &omega, &data, &sigma ) )
+        return NULL;
+    if ( !( self = (ModelObject*)type->tp_alloc( type, 0 ) ) )
+        return NULL;
+    if ( !( self->omega = model_array( omega, "omega", -1 ) ) )
+        goto fail;
+    self->n = PyArray_SIZE( self->omega );
+    if ( data!=Py_None &&
+         !( self->data = model_array( data, "data", self->n ) ) )
+        goto fail;
+    if ( sigma!=Py_None &&
+         !( self->sigma = model_array( sigma, "sigma", self->n ) ) )
+        goto fail;
+    if ( !( self->buf = PyMem_RawMalloc( 4*(self->n ? self->n : 1)*
+                                         sizeof(double) ) ) ||
+         !( self->lock = PyThread_allocate_lock() ) ) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    return (PyObject*)self;
+fail:
+    Py_DECREF( self );
+    return NULL;
+}
+
+static void model_dealloc( ModelObject* self )
+{
+    Py_XDECREF( self->omega );
+    Py_XDECREF( self->data );
+    Py_XDECREF( self->sigma );
+    kww_plan_destroy( self->plan );
+    PyMem_RawFree( self->buf );
+    if ( self->lock )
+        PyThread_free_lock( self->lock );
+    Py_TYPE( self )->tp_free( (PyObject*)self );
+}
+
+/* Computes kwwc, and its derivatives if deriv, at omega*tau into M->buf,
+   unless they are there already. Returns the number of failed points, or
+   a negative error code. Needs M->lock, and no GIL. */
+static Py_ssize_t model_kwwc( ModelObject* M, const double* p, const int deriv )
+{
+    const Py_ssize_t n = M->n;
+    const double* w = PyArray_DATA( M->omega );
+    double* x = M->buf;
+    size_t nfail;
+    if ( M->cached && !memcmp( p, M->p, sizeof(M->p) ) )
+        return 0;
+    // the plan is shared by all evaluations with the same beta
+    if ( !M->plan || kww_plan_beta( M->plan )!=p[2] ) {
+        kww_plan_destroy( M->plan );
+        if ( !( M->plan = kww_plan_create( p[2] ) ) )
+            return KWW_ENOMEM;
+    }
+    for ( Py_ssize_t i=0; i<n; ++i )
+        x[i] = w[i]*p[1];
+    if ( deriv )
+        nfail = kwwc_deriv_plan_array_e( M->plan, x, n, x+n, x+2*n, x+3*n,
+                                         NULL );
+    else
+        nfail = kwwc_plan_array_e( M->plan, x, n, x+n, NULL );
+    memcpy( M->p, p, sizeof(M->p) );
+    M->cached = deriv && !nfail;
+    return nfail;
+}
+
+/* Writes the outputs requested by what to f, r, J. Needs M->lock. */
+static void model_write( const ModelObject* M, const double* p, const int what,
+                         double* f, double* r, double* J )
+{
+    const Py_ssize_t n = M->n;
+    const double* x = M->buf;
+    const double* c = x+n;
+    const double* dc = x+2*n;
+    const double* db = x+3*n;
+    const double* y = M->data ? PyArray_DATA( M->data ) : NULL;
+    const double* s = M->sigma ? PyArray_DATA( M->sigma ) : NULL;
+    const double A = p[0], tau = p[1], bg = p[3];
+    for ( Py_ssize_t i=0; i<n; ++i ) {
+        const double fi = A*tau*c[i] + bg;
+        const double ws = s && !( what & MODEL_RAW ) ? 1/s[i] : 1;
+        if ( what & MODEL_F )
+            f[i] = fi;
+        if ( what & MODEL_RESID )
+            r[i] = s ? ( fi-y[i] )/s[i] : fi-y[i];
+        if ( what & MODEL_JAC ) {
+            J[4*i  ] = tau*c[i]*ws;
+            J[4*i+1] = A*( c[i] + x[i]*dc[i] )*ws;
+            J[4*i+2] = A*tau*db[i]*ws;
+            J[4*i+3] = ws;
+        }
+    }
+}
+
+/* Evaluates the outputs requested by what at parameters arg. Returns f, r,
+   or J, or a tuple (f, J), as new arrays. */
+static PyObject* model_run( ModelObject* self, PyObject* arg, const int what )
+{
+    PyArrayObject* pa;
+    double p[4];
+    npy_intp dims[2] = { self->n, 4 };
+    PyObject* out[2] = { NULL, NULL };
+    int nout = 0;
+    Py_ssize_t nfail;
+
+    if ( !( pa = (PyArrayObject*)PyArray_FROM_OTF( arg, NPY_DOUBLE,
+                                                   NPY_ARRAY_IN_ARRAY ) ) )
+        return NULL;
+    if ( PyArray_SIZE( pa )!=4 ) {
+        PyErr_SetString( PyExc_ValueError,
+                         "p must have 4 elements: A, tau, beta, bg" );
+        Py_DECREF( pa );
+        return NULL;
+    }
+    memcpy( p, PyArray_DATA( pa ), sizeof(p) );
+    Py_DECREF( pa );
+    if ( !( p[1]>0 && p[1]<INFINITY ) ) {
+        PyErr_SetString( PyExc_ValueError, "tau must be positive" );
+        return NULL;
+    }
+    if ( !( p[2]>=0.1 && p[2]<=2.0 ) ) {
+        PyErr_SetString( PyExc_ValueError, "beta out of range 0.1..2" );
+        return NULL;
+    }
+    if ( ( what & MODEL_RESID ) && !self->data ) {
+        PyErr_SetString( PyExc_ValueError, "model has no data" );
+        return NULL;
+    }
+    if ( what & ( MODEL_F | MODEL_RESID ) )
+        if ( !( out[nout++] = PyArray_SimpleNew( 1, dims, NPY_DOUBLE ) ) )
+            goto fail;
+    if ( what & MODEL_JAC )
+        if ( !( out[nout++] = PyArray_SimpleNew( 2, dims, NPY_DOUBLE ) ) )
+            goto fail;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock( self->lock, WAIT_LOCK );
+    // residuals are mostly followed by the Jacobian at the same p
+    nfail = model_kwwc( self, p, what & ( MODEL_RESID | MODEL_JAC ) );
+    if ( !nfail ) {
+        double* o0 = PyArray_DATA( (PyArrayObject*)out[0] );
+        double* J = PyArray_DATA( (PyArrayObject*)out[nout-1] );
+        model_write( self, p, what, o0, o0, J );
+    }
+    PyThread_release_lock( self->lock );
+    Py_END_ALLOW_THREADS
+
+    if ( nfail==KWW_ENOMEM ) {
+        PyErr_NoMemory();
+        goto fail;
+    } else if ( nfail ) {
+        PyErr_Format( PyExc_ValueError, "kwwc failed at %zd points", nfail );
+        goto fail;
+    }
+    if ( nout==1 )
+        return out[0];
+    return Py_BuildValue( "(NN)", out[0], out[1] );
+fail:
+    Py_XDECREF( out[0] );
+    Py_XDECREF( out[1] );
+    return NULL;
+}
+
+static PyObject* model_call( ModelObject* self, PyObject* args, PyObject* kw )
+{
+    static char* kwlist[] = { "p", NULL };
+    PyObject* p;
+    if ( !PyArg_ParseTupleAndKeywords( args, kw, "O", kwlist, &p ) )
+        return NULL;
+    return model_run( self, p, MODEL_F );
+}
+
+static PyObject* model_residuals( ModelObject* self, PyObject* p )
+{
+    return model_run( self, p, MODEL_RESID );
+}
+
+static PyObject* model_jac( ModelObject* self, PyObject* p )
+{
+    return model_run( self, p, MODEL_JAC );
+}
+
+static PyObject* model_evaluate( ModelObject* self, PyObject* p )
+{
+    return model_run( self, p, MODEL_F | MODEL_JAC | MODEL_RAW );
+}
+
+static PyObject* model_get_omega( ModelObject* self, void* closure )
+{
+    Py_INCREF( self->omega );
+    return (PyObject*)self->omega;
+}
+
+static PyMethodDef model_methods[] = {
+    { "residuals", (PyCFunction)model_residuals, METH_O,
+      "residuals(p)\n\n(model(p)-data)/sigma, for least-squares fits as with\n"
+      "scipy.optimize.least_squares. Also computes the Jacobian, for a\n"
+      "following call of jac(p) with the same p." },
+    { "jac", (PyCFunction)model_jac, METH_O,
+      "jac(p)\n\nJacobian of residuals(p), an array of shape (n, 4) with\n"
+      "columns d/dA, d/dtau, d/dbeta, d/dbg, divided by sigma." },
+    { "evaluate", (PyCFunction)model_evaluate, METH_O,
+      "evaluate(p)\n\n(model(p), Jacobian of model(p)), both not divided\n"
+      "by sigma." },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyGetSetDef model_getset[] = {
+    { "omega", (getter)model_get_omega, NULL, "frequencies, a copy", NULL },
+    { NULL, NULL, NULL, NULL, NULL }
+};
+
+static PyTypeObject ModelType = {
+    PyVarObject_HEAD_INIT( NULL, 0 )
+    .tp_name = "kww_native.Model",
+    .tp_basicsize = sizeof(ModelObject),
+    .tp_dealloc = (destructor)model_dealloc,
+    .tp_call = (ternaryfunc)model_call,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Model(omega, data=None, sigma=None)\n\n"
+              "A*tau*kwwc(omega*tau, beta) + bg, with parameters\n"
+              "p = (A, tau, beta, bg). model(p) returns the values at omega.\n"
+              "Derivatives are analytic; kwwc and its derivatives share one\n"
+              "plan per beta. Raises ValueError if kwwc fails.",
+    .tp_methods = model_methods,
+    .tp_getset = model_getset,
+    .tp_new = model_new,
+};
+
+/*****************************************************************************/
+/*  XLA custom calls, for kww_jax                                            */
+/*****************************************************************************/
+
+/* Points gathered per library call for float32 */
+#define XLA_CHUNK 1024
+
+#define XLA_LOAD(p,i) \
+    ( single ? (double)((const float*)(p))[i] : ((const double*)(p))[i] )
+
+/* Computes kwwc, and its derivatives by omega and beta if nout==3, at
+   points i=0..n-1 with omega w[i] and beta[i], of type float64, or float32
+   if single. Runs of equal beta are passed to the array calls of the
+   library. Failed points are NaN. */
+static void xla_eval( const int single, const int nout, const int64_t n,
+                      const void* w, const void* beta, void* const* out )
+{
+    const int64_t maxrun = single ? XLA_CHUNK : n;
+    double wbuf[XLA_CHUNK];
+    double obuf[3][XLA_CHUNK];
+
+    for ( int64_t i=0; i<n; ) {
+        const double b = XLA_LOAD( beta, i );
+        const double* wi = single ? wbuf : (const double*)w+i;
+        double* o[3];
+        int64_t m = 1;
+        while ( m<maxrun && i+m<n && XLA_LOAD( beta, i+m )==b )
+            ++m;
+        for ( int k=0; k<nout; ++k )
+            o[k] = single ? obuf[k] : (double*)out[k]+i;
+        if ( single )
+            for ( int64_t l=0; l<m; ++l )
+                wbuf[l] = XLA_LOAD( w, i+l );
+        if ( nout==3 )
+            kwwc_deriv_array_e( wi, m, b, o[0], o[1], o[2], NULL );
+        else
+            kwwc_array_e( wi, m, b, o[0], NULL );
+        if ( single )
+            for ( int k=0; k<nout; ++k )
+                for ( int64_t l=0; l<m; ++l )
+                    ((float*)out[k])[i+l] = (float)obuf[k][l];
+        i += m;
+    }
+}
+
+/* Targets of the original CPU custom call API: in[0] points to the number
+   of points as int32, in[1] to omega, in[2] to beta, of equal type; out is
+   the result, or an array of pointers to kwwc, d/domega, d/dbeta. */
+static void xla_kwwc_f64( void* out, const void** in )
+{
+    xla_eval( 0, 1, *(const int32_t*)in[0], in[1], in[2], &out );
+}
+
+static void xla_kwwc_f32( void* out, const void** in )
+{
+    xla_eval( 1, 1, *(const int32_t*)in[0], in[1], in[2], &out );
+}
+
+static void xla_kwwc_deriv_f64( void* out, const void** in )
+{
+    xla_eval( 0, 3, *(const int32_t*)in[0], in[1], in[2], out );
+}
+
+static void xla_kwwc_deriv_f32( void* out, const void** in )
+{
+    xla_eval( 1, 3, *(const int32_t*)in[0], in[1], in[2], out );
+}
+
+/* Dictionary of capsules, as expected by jax.ffi.register_ffi_target */
+static PyObject* xla_targets( void )
+{
+    static const struct {
+        const char* name;
+        void ( *fn )( void*, const void** );
+    } targets[] = {
+        { "kwwc_f64", xla_kwwc_f64 },
+        { "kwwc_f32", xla_kwwc_f32 },
+        { "kwwc_deriv_f64", xla_kwwc_deriv_f64 },
+        { "kwwc_deriv_f32", xla_kwwc_deriv_f32 } };
+    PyObject* d = PyDict_New();
+    if ( !d )
+        return NULL;
+    for ( size_t k=0; k<sizeof(targets)/sizeof(targets[0]); ++k ) {
+        // a function pointer is passed as object pointer, as XLA expects
+        union { void ( *fn )( void*, const void** ); void* p; } u;
+        PyObject* c;
+        u.fn = targets[k].fn;
+        c = PyCapsule_New( u.p, "xla._CUSTOM_CALL_TARGET", NULL );
+        if ( !c || PyDict_SetItemString( d, targets[k].name, c ) ) {
+            Py_XDECREF( c );
+            Py_DECREF( d );
+            return NULL;
+        }
+        Py_DECREF( c );
+    }
+    return d;
+}
+
+/*****************************************************************************/
+/*  Module                                                                   */
+/*****************************************************************************/
+
+static PyMethodDef methods[] = {
+    { "kwwc", KW_METH( py_kwwc ),
+      "kwwc(omega, beta, out=None, status=None)\n\n"
+      "Integral from 0 to infinity dt cos(omega*t) exp(-t^beta).\n"
+      "omega is a number, or an array-like, read without copying if it is\n"
+      "C-contiguous float64. Results go to out, a writable float64 buffer,\n"
+      "or to a new array. Status codes go to status, an int32 buffer.\n"
+      "Failed points are NaN." },
+    { "kwws", KW_METH( py_kwws ),
+      "kwws(omega, beta, out=None, status=None)\n\n"
+      "Integral from 0 to infinity dt sin(omega*t) exp(-t^beta).\n"
+      "Arguments as for kwwc." },
+    { "kwwp", KW_METH( py_kwwp ),
+      "kwwp(omega, beta, out=None, status=None)\n\n"
+      "Integral from 0 to omega dw kwwc(w, beta).\n"
+      "Arguments as for kwwc." },
+    { "complex", KW_METH( py_complex ),
+      "complex(omega, beta, re=None, im=None, status=None)\n\n"
+      "(kwwc, kwws), computed together. Arguments as for kwwc." },
+    { "init", KW_METH( py_init ),
+      "init(beta_min=0, beta_max=0, niter=0)\n\n"
+      "Builds the integration tables up front, as kww_init." },
+    { "finalize", (PyCFunction)py_finalize, METH_NOARGS,
+      "finalize()\n\n"
+      "Releases the integration tables, as kww_finalize. Must not run\n"
+      "concurrently with other calls." },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef module = {
+    PyModuleDef_HEAD_INIT, "kww_native",
+    "Kohlrausch-Williams-Watts functions, i.e. Fourier transforms of the\n"
+    "stretched exponential exp(-t^beta)", -1, methods };
+
+PyMODINIT_FUNC PyInit_kww_native( void )
+{
+    PyObject* m;
+    import_array();
+    if ( PyType_Ready( &PlanType ) < 0 || PyType_Ready( &ModelType ) < 0 )
+        return NULL;
+    if ( !( m = PyModule_Create( &module ) ) )
+        return NULL;
+    Py_INCREF( &PlanType );
+    if ( PyModule_AddObject( m, "Plan", (PyObject*)&PlanType ) ) {
+        Py_DECREF( &PlanType );
+        Py_DECREF( m );
+        return NULL;
+    }
+    Py_INCREF( &ModelType );
+    if ( PyModule_AddObject( m, "Model", (PyObject*)&ModelType ) ) {
+        Py_DECREF( &ModelType );
+        Py_DECREF( m );
+        return NULL;
+    }
+    if ( PyModule_AddIntConstant( m, "EDOM", KWW_EDOM ) ||
+         PyModule_AddIntConstant( m, "ENOMEM", KWW_ENOMEM ) ||
+         PyModule_AddObject( m, "TOL_MIN",
+                             PyFloat_FromDouble( KWW_TOL_MIN ) ) ||
+         PyModule_AddObject( m, "TOL_MAX",
+                             PyFloat_FromDouble( KWW_TOL_MAX ) ) ||
+         PyModule_AddObject( m, "xla_targets", xla_targets() ) ) {
+        Py_DECREF( m );
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,168 @@
+/* kww_ufunc.c:
+ *   NumPy ufuncs kwwc, kwws, kwwp, with broadcasting of omega against beta,
+ *   and with out=, where=, dtype= as for any ufunc.
+ *   Runs of points with the same beta are passed to the array calls of
+ *   the library.
+ *
+ * Copyright:
+ *   (C) 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+#include <numpy/ufuncobject.h>
+#include <math.h>
+#include <fenv.h>
+#include "kww.h"
+
+/* Points gathered per library call, where the arrays are not contiguous */
+#define CHUNK 1024
+
+typedef size_t kww_array_fn( const double* w, const size_t n,
+                             const double beta, double* out, int* status );
+
+static kww_array_fn* const array_fn[3] = {
+    kwwc_array_e, kwws_array_e, kwwp_array_e };
+
+/* Evaluates kind at w[0..n-1] for one beta. Failures leave NaN in out[i];
+   returns 1 if a failure was not caused by NaN input. */
+static int eval_run( const int kind, const double* w, const size_t n,
+                     const double beta, double* out )
+{
+    if ( !array_fn[kind]( w, n, beta, out, NULL ) || isnan( beta ) )
+        return 0;
+    for ( size_t i=0; i<n; ++i )
+        if ( isnan( out[i] ) && !isnan( w[i] ) )
+            return 1;
+    return 0;
+}
+
+#define LOAD(p) ( single ? (double)*(const float*)(p) : *(const double*)(p) )
+
+/* Inner loop for float64 (single=0) or float32 (single=1) */
+static void kww_loop( char** args, const npy_intp* dims, const npy_intp* steps,
+                      const int kind, const int single )
+{
+    const npy_intp n = dims[0];
+    const char* pw = args[0];
+    const char* pb = args[1];
+    char* po = args[2];
+    const npy_intp sw = steps[0], sb = steps[1], so = steps[2];
+    // contiguous float64: pass the arrays to the library without copying,
+    // which takes out==w, but no partial overlap; NumPy copies partially
+    // overlapping operands before calling the loop, this checks it anyway
+    const int direct = !single && sw==sizeof(double) && so==sizeof(double) &&
+        ( pw==po || pw+n*sw<=po || po+n*so<=pw );
+    const npy_intp maxrun = direct ? n : CHUNK;
+    double wbuf[CHUNK];
+    double obuf[CHUNK];
+    int invalid = 0;
+
+    for ( npy_intp i=0; i<n; ) {
+        const double beta = LOAD( pb+i*sb );
+        npy_intp m = 1;
+        // run of points with the same beta
+        while ( m<maxrun && i+m<n && ( sb==0 || LOAD( pb+(i+m)*sb )==beta ) )
+            ++m;
+        if ( direct ) {
+            invalid |= eval_run( kind, (const double*)( pw+i*sw ), m, beta,
+                                 (double*)( po+i*so ) );
+        } else {
+            for ( npy_intp l=0; l<m; ++l )
+                wbuf[l] = LOAD( pw+(i+l)*sw );
+            invalid |= eval_run( kind, wbuf, m, beta, obuf );
+            for ( npy_intp l=0; l<m; ++l ) {
+                if ( single )
+                    *(float*)( po+(i+l)*so ) = (float)obuf[l];
+                else
+                    *(double*)( po+(i+l)*so ) = obuf[l];
+            }
+        }
+        i += m;
+    }
+    // reported by NumPy according to np.errstate, as for other ufuncs
+    if ( invalid )
+        feraiseexcept( FE_INVALID );
+}
+
+static void loop_d( char** args, const npy_intp* dims, const npy_intp* steps,
+                    void* data )
+{
+    kww_loop( args, dims, steps, *(const int*)data, 0 );
+}
+
+static void loop_f( char** args, const npy_intp* dims, const npy_intp* steps,
+                    void* data )
+{
+    kww_loop( args, dims, steps, *(const int*)data, 1 );
+}
+
+static PyUFuncGenericFunction loops[2] = { loop_f, loop_d };
+static const char types[6] = { NPY_FLOAT, NPY_FLOAT, NPY_FLOAT,
+                               NPY_DOUBLE, NPY_DOUBLE, NPY_DOUBLE };
+static const int kinds[3] = { KWW_C, KWW_S, KWW_P };
+static void* data[3][2] = {
+    { (void*)&kinds[0], (void*)&kinds[0] },
+    { (void*)&kinds[1], (void*)&kinds[1] },
+    { (void*)&kinds[2], (void*)&kinds[2] } };
+
+static const char* const names[3] = { "kwwc", "kwws", "kwwp" };
+static const char* const docs[3] = {
+    "kwwc(omega, beta, /, out=None, *, where=True, ...)\n\n"
+    "Integral from 0 to infinity dt cos(omega*t) exp(-t^beta).\n"
+    "NaN where beta is out of range or the computation fails.",
+    "kwws(omega, beta, /, out=None, *, where=True, ...)\n\n"
+    "Integral from 0 to infinity dt sin(omega*t) exp(-t^beta).\n"
+    "NaN where beta is out of range or the computation fails.",
+    "kwwp(omega, beta, /, out=None, *, where=True, ...)\n\n"
+    "Integral from 0 to omega dw kwwc(w, beta).\n"
+    "NaN where beta is out of range or the computation fails." };
+
+static struct PyModuleDef module = {
+    PyModuleDef_HEAD_INIT, "_kww_ufunc",
+    "NumPy ufuncs kwwc, kwws, kwwp", -1, NULL };
+
+PyMODINIT_FUNC PyInit__kww_ufunc( void )
+{
+    PyObject* m;
+    import_array();
+    import_umath();
+    if ( !( m = PyModule_Create( &module ) ) )
+        return NULL;
+    for ( int k=0; k<3; ++k ) {
+        PyObject* f = PyUFunc_FromFuncAndData(
+            loops, data[k], (char*)types, 2, 2, 1, PyUFunc_None,
+            names[k], docs[k], 0 );
+        if ( !f || PyModule_AddObject( m, names[k], f ) ) {
+            Py_XDECREF( f );
+            Py_DECREF( m );
+            return NULL;
+        }
+    }
+    return m;
+}
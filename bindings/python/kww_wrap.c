@@ -13,6 +13,7 @@
 #define SWIGPYTHON
 #endif
 
+#define SWIG_PYTHON_THREADS
 #define SWIG_PYTHON_DIRECTOR_NO_VTABLE
 
 /* -----------------------------------------------------------------------------
@@ -2776,7 +2777,11 @@ SWIGINTERN PyObject *_wrap_kwwc(PyObject *SWIGUNUSEDPARM(self), PyObject *args)
     SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "kwwc" "', argument " "2"" of type '" "double""'");
   } 
   arg2 = (double)(val2);
-  result = (double)kwwc(arg1,arg2);
+  {
+    SWIG_PYTHON_THREAD_BEGIN_ALLOW;
+    result = (double)kwwc(arg1,arg2);
+    SWIG_PYTHON_THREAD_END_ALLOW;
+  }
   resultobj = SWIG_From_double((double)(result));
   return resultobj;
 fail:
@@ -2806,7 +2811,11 @@ SWIGINTERN PyObject *_wrap_kwws(PyObject *SWIGUNUSEDPARM(self), PyObject *args)
     SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "kwws" "', argument " "2"" of type '" "double""'");
   } 
   arg2 = (double)(val2);
-  result = (double)kwws(arg1,arg2);
+  {
+    SWIG_PYTHON_THREAD_BEGIN_ALLOW;
+    result = (double)kwws(arg1,arg2);
+    SWIG_PYTHON_THREAD_END_ALLOW;
+  }
   resultobj = SWIG_From_double((double)(result));
   return resultobj;
 fail:
@@ -2836,7 +2845,11 @@ SWIGINTERN PyObject *_wrap_kwwp(PyObject *SWIGUNUSEDPARM(self), PyObject *args)
     SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "kwwp" "', argument " "2"" of type '" "double""'");
   } 
   arg2 = (double)(val2);
-  result = (double)kwwp(arg1,arg2);
+  {
+    SWIG_PYTHON_THREAD_BEGIN_ALLOW;
+    result = (double)kwwp(arg1,arg2);
+    SWIG_PYTHON_THREAD_END_ALLOW;
+  }
   resultobj = SWIG_From_double((double)(result));
   return resultobj;
 fail:
@@ -3604,6 +3617,9 @@ SWIG_init(void) {
   
   SWIG_InstallConstants(d,swig_const_table);
   
+  
+  /* Initialize threading */
+  SWIG_PYTHON_INITIALIZE_THREADS;
 #if PY_VERSION_HEX >= 0x03000000
   return m;
 #else
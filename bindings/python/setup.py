@@ -1,5 +1,26 @@
 import distutils.core
 
+# NumPy ufuncs and the module kww_native with the fit model, linked
+# against the kww library built with CMake; only if NumPy is available
+try:
+	import numpy
+	ufunc_ext = [
+		distutils.core.Extension(
+			'_kww_ufunc',
+			['kww_ufunc.c'],
+			include_dirs = ['../../lib', numpy.get_include()],
+			libraries = ['kww']
+		),
+		distutils.core.Extension(
+			'kww_native',
+			['kww_native.c'],
+			include_dirs = ['../../lib', numpy.get_include()],
+			libraries = ['kww']
+		)
+	]
+except ImportError:
+	ufunc_ext = []
+
 distutils.core.setup(
 	name = 'kww-python',
 	author = 'Joachim Wuttke',
@@ -13,8 +34,8 @@ distutils.core.setup(
 			['kww.c', 'kww.i'],
 			extra_compile_args = ['--std=c99']
 		)
-	],
+	] + ufunc_ext,
 	py_modules = [
 		'kww'
-	],
+	] + ( ['kww_jax'] if ufunc_ext else [] ),
 )
@@ -0,0 +1,91 @@
+/* kww_benchtol.c
+ *
+ * Copyright (C) 2023 Joachim Wuttke
+ *
+ * Licence: GNU General Public License, version 3 or later
+ *
+ * Author:
+ *   Joachim Wuttke, Forschungszentrum Jülich, Germany <j.wuttke@fz-juelich.de>
+ *
+ * Purpose:
+ *   Measure computing time and actual error as function of the tolerance
+ *   set by kww_plan_set_tol.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "kww.h"
+
+int main( int argc, char **argv )
+{
+    const double tols[] = { KWW_TOL_MIN, 1e-14, 1e-12, 1e-10, 1e-8, 1e-6,
+                            1e-4, 1e-3, KWW_TOL_MAX };
+    const int ntol = sizeof(tols)/sizeof(tols[0]);
+    const double betas[] = { .2, .5, .8, 1.2, 1.6, 1.9 };
+    const int nb = sizeof(betas)/sizeof(betas[0]);
+    int nw, kind, j, i, t;
+    double *w, *exact, *out;
+    double t_full = 0;
+
+    if( argc!=2 ){
+        fprintf( stderr,  "usage:\n" );
+        fprintf( stderr,  "   %s <nw>\n", argv[0] );
+        fprintf( stderr,  "with argument:\n" );
+        fprintf( stderr,  "   <nw>: number of omega's per beta and function,"
+                 " log-spaced in 1e-3..1e3\n" );
+        fprintf( stderr,  "output:\n" );
+        fprintf( stderr,  "   tol, time per call, speedup, max relative error\n" );
+        exit(-1);
+    }
+    nw = atoi(argv[1]);
+    if( nw<2 ){
+        fprintf( stderr,  "<nw> must be at least 2\n" );
+        exit(-1);
+    }
+    w = malloc( nw*sizeof(double) );
+    exact = malloc( 3*nb*nw*sizeof(double) );
+    out = malloc( nw*sizeof(double) );
+    if( !w || !exact || !out ){
+        fprintf( stderr,  "allocation failed\n" );
+        exit(1);
+    }
+    for( i=0; i<nw; ++i )
+        w[i] = pow( 10., -3 + 6.*i/(nw-1) );
+
+    printf( "%9s %12s %8s %12s\n", "tol", "us/call", "speedup", "max relerr" );
+    for( t=0; t<ntol; ++t ){
+        double dt, maxerr = 0;
+        clock_t c0 = clock();
+        for( j=0; j<nb; ++j ){
+            kww_plan* plan = kww_plan_create( betas[j] );
+            if( !plan || kww_plan_set_tol( plan, tols[t] ) ){
+                fprintf( stderr,  "cannot create plan\n" );
+                exit(1);
+            }
+            for( kind=KWW_C; kind<=KWW_P; ++kind ){
+                double* ref = exact + (kind*nb+j)*nw;
+                double* res = t ? out : ref;
+                if( kind==KWW_C )
+                    kwwc_plan_array( plan, w, nw, res );
+                else if( kind==KWW_S )
+                    kwws_plan_array( plan, w, nw, res );
+                else
+                    kwwp_plan_array( plan, w, nw, res );
+                for( i=0; t && i<nw; ++i )
+                    maxerr = fmax( maxerr, fabs( out[i]/ref[i]-1 ) );
+            }
+            kww_plan_destroy( plan );
+        }
+        dt = (double)( clock()-c0 ) / CLOCKS_PER_SEC;
+        if( !t )
+            t_full = dt;
+        printf( "%9.2g %12.3f %8.2f %12.3g\n",
+                tols[t], dt/(3*nb*nw)*1e6, t_full/dt, maxerr );
+    }
+    free( w );
+    free( exact );
+    free( out );
+    return 0;
+}
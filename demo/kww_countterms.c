@@ -18,7 +18,7 @@
 #include "kww.h"
 #include "kww_lowlevel.h"
 
-KWW_IMPORT extern int kww_num_of_terms;
+KWW_IMPORT extern _Thread_local int kww_num_of_terms;
 
 double kwwc_lim_low( const double beta );
 double kwwc_lim_hig( const double beta );
@@ -17,8 +17,8 @@
 #include "kww.h"
 #include "kww_lowlevel.h"
 
-KWW_IMPORT extern int kww_algorithm;
-KWW_IMPORT extern int kww_num_of_terms;
+KWW_IMPORT extern _Thread_local int kww_algorithm;
+KWW_IMPORT extern _Thread_local int kww_num_of_terms;
 KWW_IMPORT extern int kww_debug;
 
 int main( int argc, char **argv )
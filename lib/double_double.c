@@ -0,0 +1,361 @@
+/* double_double.c:
+ *   Transcendental functions of Xdouble arguments, computed in double-double
+ *   arithmetic (pairs of hardware doubles). Compiled if USE_DOUBLE_DOUBLE.
+ *
+ * Reference:
+ *   Hida, Li, Bailey, Library for double-double and quad-double arithmetic
+ *   (2007), for the basic operations.
+ *
+ * Copyright:
+ *   (C) 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ */
+
+#include <math.h>
+#include "extended_double.h"
+
+/*****************************************************************************/
+/*  Basic operations                                                         */
+/*****************************************************************************/
+
+/* Unevaluated sum hi+lo, with |lo| <= ulp(hi)/2 */
+typedef struct {
+    double hi;
+    double lo;
+} dd;
+
+// requires |a|>=|b|
+static inline dd quick_two_sum( const double a, const double b )
+{
+    const double s = a+b;
+    return (dd){ s, b-(s-a) };
+}
+
+static inline dd two_sum( const double a, const double b )
+{
+    const double s = a+b;
+    const double bb = s-a;
+    return (dd){ s, (a-(s-bb)) + (b-bb) };
+}
+
+static inline dd two_prod( const double a, const double b )
+{
+    const double p = a*b;
+#ifdef FP_FAST_FMA
+    return (dd){ p, fma( a, b, -p ) };
+#else
+    // Dekker's algorithm
+    const double split = 134217729.0; // 2^27+1
+    double t = split*a;
+    const double ahi = t-(t-a), alo = a-ahi;
+    t = split*b;
+    const double bhi = t-(t-b), blo = b-bhi;
+    return (dd){ p, ((ahi*bhi-p) + ahi*blo + alo*bhi) + alo*blo };
+#endif
+}
+
+static inline dd dd_add( const dd a, const dd b )
+{
+    dd s = two_sum( a.hi, b.hi );
+    const dd t = two_sum( a.lo, b.lo );
+    s.lo += t.hi;
+    s = quick_two_sum( s.hi, s.lo );
+    s.lo += t.lo;
+    return quick_two_sum( s.hi, s.lo );
+}
+
+static inline dd dd_add_d( const dd a, const double b )
+{
+    dd s = two_sum( a.hi, b );
+    s.lo += a.lo;
+    return quick_two_sum( s.hi, s.lo );
+}
+
+static inline dd dd_neg( const dd a )
+{
+    return (dd){ -a.hi, -a.lo };
+}
+
+static inline dd dd_sub( const dd a, const dd b )
+{
+    return dd_add( a, dd_neg( b ) );
+}
+
+static inline dd dd_mul( const dd a, const dd b )
+{
+    dd p = two_prod( a.hi, b.hi );
+    p.lo += a.hi*b.lo + a.lo*b.hi;
+    return quick_two_sum( p.hi, p.lo );
+}
+
+static inline dd dd_mul_d( const dd a, const double b )
+{
+    dd p = two_prod( a.hi, b );
+    p.lo += a.lo*b;
+    return quick_two_sum( p.hi, p.lo );
+}
+
+static inline dd dd_div( const dd a, const dd b )
+{
+    const double q1 = a.hi/b.hi;
+    dd r = dd_sub( a, dd_mul_d( b, q1 ) );
+    const double q2 = r.hi/b.hi;
+    r = dd_sub( r, dd_mul_d( b, q2 ) );
+    const double q3 = r.hi/b.hi;
+    return dd_add_d( quick_two_sum( q1, q2 ), q3 );
+}
+
+static inline dd dd_ldexp( const dd a, const int n )
+{
+    return (dd){ ldexp( a.hi, n ), ldexp( a.lo, n ) };
+}
+
+static inline dd from_X( const Xdouble x )
+{
+    const double hi = (double)x;
+    if ( !isfinite( hi ) )
+        return (dd){ hi, 0 };
+    return (dd){ hi, (double)( x-hi ) };
+}
+
+static inline Xdouble to_X( const dd a )
+{
+    return (Xdouble)a.hi + a.lo;
+}
+
+/*****************************************************************************/
+/*  Constants                                                                */
+/*****************************************************************************/
+
+static const dd LN2 = { 0x1.62e42fefa39efp-1, 0x1.abc9e3b39803fp-56 };
+// log(2*pi)/2
+static const dd HALF_LOG_2PI = { 0x1.d67f1c864beb5p-1, -0x1.65b5a1b7ff5dfp-55 };
+// pi/2 as a sum of three doubles
+static const double PI_2_0 = 0x1.921fb54442d18p+0;
+static const double PI_2_1 = 0x1.1a62633145c07p-54;
+static const double PI_2_2 = -0x1.f1976b7ed8fbcp-110;
+
+#define NFACT 30
+static const dd inv_fact[NFACT+1] = {
+    { 0x1.0000000000000p+0, 0.0 }, // 1/0!
+    { 0x1.0000000000000p+0, 0.0 }, // 1/1!
+    { 0x1.0000000000000p-1, 0.0 }, // 1/2!
+    { 0x1.5555555555555p-3, 0x1.5555555555555p-57 }, // 1/3!
+    { 0x1.5555555555555p-5, 0x1.5555555555555p-59 }, // 1/4!
+    { 0x1.1111111111111p-7, 0x1.1111111111111p-63 }, // 1/5!
+    { 0x1.6c16c16c16c17p-10, -0x1.f49f49f49f49fp-65 }, // 1/6!
+    { 0x1.a01a01a01a01ap-13, 0x1.a01a01a01a01ap-73 }, // 1/7!
+    { 0x1.a01a01a01a01ap-16, 0x1.a01a01a01a01ap-76 }, // 1/8!
+    { 0x1.71de3a556c734p-19, -0x1.c154f8ddc6c00p-73 }, // 1/9!
+    { 0x1.27e4fb7789f5cp-22, 0x1.cbbc05b4fa99ap-76 }, // 1/10!
+    { 0x1.ae64567f544e4p-26, -0x1.c062e06d1f209p-80 }, // 1/11!
+    { 0x1.1eed8eff8d898p-29, -0x1.2aec959e14c06p-83 }, // 1/12!
+    { 0x1.6124613a86d09p-33, 0x1.f28e0cc748ebep-87 }, // 1/13!
+    { 0x1.93974a8c07c9dp-37, 0x1.05d6f8a2efd1fp-92 }, // 1/14!
+    { 0x1.ae7f3e733b81fp-41, 0x1.1d8656b0ee8cbp-97 }, // 1/15!
+    { 0x1.ae7f3e733b81fp-45, 0x1.1d8656b0ee8cbp-101 }, // 1/16!
+    { 0x1.952c77030ad4ap-49, 0x1.ac981465ddc6cp-103 }, // 1/17!
+    { 0x1.6827863b97d97p-53, 0x1.eec01221a8b0bp-107 }, // 1/18!
+    { 0x1.2f49b46814157p-57, 0x1.2650f61dbdcb4p-112 }, // 1/19!
+    { 0x1.e542ba4020225p-62, 0x1.ea72b4afe3c2fp-120 }, // 1/20!
+    { 0x1.71b8ef6dcf572p-66, -0x1.d043ae40c4647p-120 }, // 1/21!
+    { 0x1.0ce396db7f853p-70, -0x1.aebcdbd20331cp-124 }, // 1/22!
+    { 0x1.761b41316381ap-75, -0x1.3423c7d91404fp-130 }, // 1/23!
+    { 0x1.f2cf01972f578p-80, -0x1.9ada5fcc1ab14p-135 }, // 1/24!
+    { 0x1.3f3ccdd165fa9p-84, -0x1.58ddadf344487p-139 }, // 1/25!
+    { 0x1.88e85fc6a4e5ap-89, -0x1.71c37ebd16540p-143 }, // 1/26!
+    { 0x1.d1ab1c2dccea3p-94, 0x1.054d0c78aea14p-149 }, // 1/27!
+    { 0x1.0a18a2635085dp-98, 0x1.b9e2e28e1aa54p-153 }, // 1/28!
+    { 0x1.259f98b4358adp-103, 0x1.eaf8c39dd9bc5p-157 }, // 1/29!
+    { 0x1.3932c5047d60ep-108, 0x1.832b7b530a627p-162 }, // 1/30!
+};
+
+// coefficients B_2k/(2k(2k-1)) of the Stirling series
+#define NSTIRLING 15
+static const dd stirling[NSTIRLING] = {
+    { 0x1.5555555555555p-4, 0x1.5555555555555p-58 }, // 1/12
+    { -0x1.6c16c16c16c17p-9, 0x1.f49f49f49f49fp-64 }, // -1/360
+    { 0x1.a01a01a01a01ap-11, 0x1.a01a01a01a01ap-71 }, // 1/1260
+    { -0x1.3813813813814p-11, 0x1.fb1fb1fb1fb20p-65 }, // -1/1680
+    { 0x1.b951e2b18ff23p-11, 0x1.5c3a9ce01b952p-65 }, // 1/1188
+    { -0x1.f6ab0d9993c7dp-10, 0x1.f82553c999b0ep-64 }, // -691/360360
+    { 0x1.a41a41a41a41ap-8, 0x1.0690690690690p-62 }, // 1/156
+    { -0x1.e4286cb0f5398p-6, 0x1.1efcdab896745p-61 }, // -3617/122400
+    { 0x1.6fe96381e0680p-3, -0x1.79e2405a71f88p-61 }, // 43867/244188
+    { -0x1.6476701181f3ap+0, 0x1.24246319da678p-56 }, // -174611/125400
+    { 0x1.ace44322ce006p+3, -0x1.62c2b1bbcdd32p-51 }, // 77683/5796
+    { -0x1.39b2525cccc1bp+7, 0x1.52604768a30fcp-47 }, // -236364091/1506960
+    { 0x1.12234e81b4e82p+11, -0x1.2c5f92c5f92c6p-43 }, // 657931/300
+    { -0x1.1a198ae1c4ab8p+15, 0x1.4c012227b696ep-41 }, // -3392780147/93960
+    { 0x1.51a2089a6e11ap+19, 0x1.c219ee4fdc447p-36 }, // 1723168255201/2492028
+};
+
+/*****************************************************************************/
+/*  Transcendental functions                                                 */
+/*****************************************************************************/
+
+static dd dd_exp( const dd a )
+{
+    if ( a.hi>709.79 )
+        return (dd){ INFINITY, 0 };
+    if ( a.hi<-745.2 )
+        return (dd){ 0, 0 };
+    if ( isnan( a.hi ) )
+        return a;
+    // a = m*log(2) + 1024*r, with |r| < 3.4e-4
+    const double m = nearbyint( a.hi/LN2.hi );
+    const dd r = dd_ldexp( dd_sub( a, dd_mul_d( LN2, m ) ), -10 );
+    // p = exp(r)-1, by Taylor series
+    dd p = inv_fact[9];
+    for ( int n=8; n>0; --n )
+        p = dd_add( dd_mul( p, r ), inv_fact[n] );
+    p = dd_mul( p, r );
+    // exp(2r)-1 = (exp(r)-1)*(exp(r)+1), keeps relative accuracy
+    for ( int i=0; i<10; ++i )
+        p = dd_mul( p, dd_add_d( p, 2 ) );
+    return dd_ldexp( dd_add_d( p, 1 ), (int)m );
+}
+
+static dd dd_log( const dd a )
+{
+    if ( !( a.hi>0 ) )
+        return (dd){ a.hi==0 ? -INFINITY : NAN, 0 };
+    if ( isinf( a.hi ) )
+        return a;
+    // one Newton step x -> x + a*exp(-x) - 1 doubles the number of digits
+    const double x = log( a.hi );
+    const dd e = dd_exp( (dd){ -x, 0 } );
+    return dd_add_d( dd_add_d( dd_mul( a, e ), -1 ), x );
+}
+
+// sin(a) if odd, else cos(a)
+static dd dd_sin_cos( const dd a, const int odd )
+{
+    if ( !isfinite( a.hi ) )
+        return (dd){ NAN, 0 };
+    // a = n*pi/2 + r, with |r| <= pi/4
+    const double n = nearbyint( a.hi/PI_2_0 );
+    dd r = dd_sub( a, two_prod( n, PI_2_0 ) );
+    r = dd_sub( r, two_prod( n, PI_2_1 ) );
+    r = dd_add_d( r, -n*PI_2_2 );
+    const int quadrant = ( (long)fmod( n, 4 ) + 4 ) % 4;
+    // sin(a) is +-sin(r) or +-cos(r)
+    const int sine = ( odd+quadrant ) % 2;
+    const int negative = odd ? quadrant>=2 : quadrant==1 || quadrant==2;
+    const dd r2 = dd_mul( r, r );
+    dd s = inv_fact[NFACT-2+sine];
+    for ( int k=NFACT-4+sine; k>=0; k-=2 )
+        s = dd_sub( inv_fact[k], dd_mul( s, r2 ) );
+    if ( sine )
+        s = dd_mul( s, r );
+    return negative ? dd_neg( s ) : s;
+}
+
+static dd dd_sinh_cosh( const dd a, const int odd )
+{
+    if ( odd && fabs( a.hi )<0.5 ) {
+        // Taylor series, to avoid cancellation
+        const dd a2 = dd_mul( a, a );
+        dd s = inv_fact[NFACT-1];
+        for ( int k=NFACT-3; k>0; k-=2 )
+            s = dd_add( dd_mul( s, a2 ), inv_fact[k] );
+        return dd_mul( s, a );
+    }
+    const dd e = dd_exp( a );
+    const dd ie = dd_div( (dd){ 1, 0 }, e );
+    return dd_ldexp( odd ? dd_sub( e, ie ) : dd_add( e, ie ), -1 );
+}
+
+static dd dd_lgamma( dd x )
+{
+    dd prod = { 1, 0 };
+    int shifted = 0;
+    if ( !( x.hi>0 ) )
+        return (dd){ NAN, 0 };
+    // lgamma(x) = lgamma(x+n) - log(x*(x+1)*...*(x+n-1))
+    while ( x.hi<20 ) {
+        prod = dd_mul( prod, x );
+        x = dd_add_d( x, 1 );
+        shifted = 1;
+    }
+    // Stirling series, with error below 1e-31 for x>=20
+    dd r = dd_sub( dd_mul( dd_add_d( x, -.5 ), dd_log( x ) ), x );
+    r = dd_add( r, HALF_LOG_2PI );
+    const dd ix = dd_div( (dd){ 1, 0 }, x );
+    const dd ix2 = dd_mul( ix, ix );
+    dd s = stirling[NSTIRLING-1];
+    for ( int k=NSTIRLING-2; k>=0; --k )
+        s = dd_add( dd_mul( s, ix2 ), stirling[k] );
+    r = dd_add( r, dd_mul( s, ix ) );
+    if ( shifted )
+        r = dd_sub( r, dd_log( prod ) );
+    return r;
+}
+
+/*****************************************************************************/
+/*  Interface                                                                */
+/*****************************************************************************/
+
+Xdouble kww_dd_cos( const Xdouble x )
+{
+    return to_X( dd_sin_cos( from_X( x ), 0 ) );
+}
+
+Xdouble kww_dd_cosh( const Xdouble x )
+{
+    return to_X( dd_sinh_cosh( from_X( x ), 0 ) );
+}
+
+Xdouble kww_dd_exp( const Xdouble x )
+{
+    return to_X( dd_exp( from_X( x ) ) );
+}
+
+Xdouble kww_dd_lgamma( const Xdouble x )
+{
+    return to_X( dd_lgamma( from_X( x ) ) );
+}
+
+Xdouble kww_dd_log( const Xdouble x )
+{
+    return to_X( dd_log( from_X( x ) ) );
+}
+
+Xdouble kww_dd_pow( const Xdouble x, const Xdouble y )
+{
+    if ( x==0 )
+        return y>0 ? 0 : y==0 ? 1 : INFINITY;
+    return to_X( dd_exp( dd_mul( from_X( y ), dd_log( from_X( x ) ) ) ) );
+}
+
+Xdouble kww_dd_sin( const Xdouble x )
+{
+    return to_X( dd_sin_cos( from_X( x ), 1 ) );
+}
+
+Xdouble kww_dd_sinh( const Xdouble x )
+{
+    return to_X( dd_sinh_cosh( from_X( x ), 1 ) );
+}
@@ -0,0 +1,53 @@
+/* double_double.h:
+ *   Transcendental functions of Xdouble arguments, computed in double-double
+ *   arithmetic (pairs of hardware doubles). Used if USE_DOUBLE_DOUBLE is set.
+ *
+ * Copyright:
+ *   (C) 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ */
+
+
+
+#ifndef DOUBLE_DOUBLE_H
+#define DOUBLE_DOUBLE_H
+
+/* To be included from extended_double.h, after Xdouble is defined. */
+
+/* Relative accuracy is about 1e-31, far better than the 5.5e-20 required
+   for the extended-precision computations in kww_lowlevel.c. Arguments
+   and results are converted from and to Xdouble, which only needs to
+   support fast arithmetic, not fast transcendental functions. */
+
+Xdouble kww_dd_cos( const Xdouble x );
+Xdouble kww_dd_cosh( const Xdouble x );
+Xdouble kww_dd_exp( const Xdouble x );
+Xdouble kww_dd_lgamma( const Xdouble x ); // only for x>0
+Xdouble kww_dd_log( const Xdouble x );
+Xdouble kww_dd_pow( const Xdouble x, const Xdouble y ); // only for x>=0
+Xdouble kww_dd_sin( const Xdouble x );
+Xdouble kww_dd_sinh( const Xdouble x );
+
+#endif // DOUBLE_DOUBLE_H
@@ -1,6 +1,8 @@
 /* extended_double.h
  *   Macros that expand to either "long double" or to "__float128".
  *   To facilitate cross-platform computations with at least extended precision.
+ *   With USE_DOUBLE_DOUBLE, the transcendental functions are computed in
+ *   double-double arithmetic, which is much faster than libquadmath.
  *
  * Copyright:
  *   (C) 2022 Joachim Wuttke
@@ -66,4 +68,27 @@
 
 #endif
 
+#ifdef USE_DOUBLE_DOUBLE
+
+    #include "double_double.h"
+
+    #undef cosX
+    #undef coshX
+    #undef expX
+    #undef lgammaX
+    #undef logX
+    #undef powX
+    #undef sinX
+    #undef sinhX
+    #define cosX kww_dd_cos
+    #define coshX kww_dd_cosh
+    #define expX kww_dd_exp
+    #define lgammaX kww_dd_lgamma
+    #define logX kww_dd_log
+    #define powX kww_dd_pow
+    #define sinX kww_dd_sin
+    #define sinhX kww_dd_sinh
+
+#endif
+
 #endif // EXTENDED_DOUBLE_H
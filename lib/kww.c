@@ -35,10 +35,12 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <errno.h>
 #include "kww.h"
 #include "kww_lowlevel.h"
+#include "kww_plan.h"
 
 #ifdef __MINGW32__
 #define printf __mingw_printf
@@ -109,108 +111,329 @@ double kwwp_lim_hig( const double b )
 
 
 /*****************************************************************************/
-/*  High-level wrapper functions                                             */
+/*  Evaluation with status code                                              */
 /*****************************************************************************/
 
-/* \int_0^\infty dt cos(w*t) exp(-t^beta) */
-double kwwc( const double w_in, const double beta )
+static const char kind_name[3] = { 'c', 's', 'p' };
+
+int kww_beta_ok( const double beta )
 {
-    double w, res;
-    /* check input data */
-    if ( beta<0.1 ) {
-        fprintf( stderr, "kww: beta smaller than 0.1\n" );
-        exit( EDOM );
+    return beta>=0.1 && beta<=2.0;
+}
+
+/* Computes *res = kwwc(w_in,beta) etc, and returns KWW_SUCCESS, or a
+   negative error code with *res = NaN. Expects beta to be checked, and
+   the range limits lim_low, lim_hig to be precomputed by the caller.
+   Series coefficients are taken from coef, or computed on the fly if coef
+   is NULL. Computations stop at relative tolerance delta. */
+int kww_at( const int kind, double* res,
+            const double w_in, const double beta,
+            const double lim_low, const double lim_hig,
+            const kww_series_coef* coef, const double delta )
+{
+    double w;
+    Xdouble s;
+    int sign_out;
+    if ( isnan( w_in ) ) {
+        *res = NAN;
+        return KWW_EDOM;
     }
-    if ( beta>2.0 ) {
-        fprintf( stderr, "kww: beta larger than 2.0\n" );
-        exit( EDOM );
+    w = fabs( w_in );
+    if ( kind==0 ) {
+        /* it's an even function; the value at w=0 is well known */
+        if ( w_in==0 ) {
+            *res = tgamma(1.0/beta)/beta;
+            return KWW_SUCCESS;
+        }
+        sign_out = 1;
+        /* special case: Gaussian for b=2 */
+        if ( beta==2 ) {
+            *res = sqrt(PI)/2*exp(-SQR((double)w)/4);
+            return KWW_SUCCESS;
+        }
+    } else {
+        /* it's an odd function */
+        if ( w_in==0 ) {
+            *res = 0;
+            return KWW_SUCCESS;
+        }
+        sign_out = w_in<0 ? -1 : 1;
+    }
+    /* try series expansion */
+    if        ( w<lim_low ) {
+        s = kww_low( w, beta, kind==1, kind==2, coef, delta );
+        if ( s>0 ) {
+            *res = sign_out*s;
+            return KWW_SUCCESS;
+        }
+    } else if ( w>lim_hig ) {
+        s = kind==2 ? kwwp_hig_coef( w, beta, coef, delta ) :
+            kww_hig( w, beta, kind==1, 0, coef, delta );
+        if ( s>0 ) {
+            *res = sign_out*s;
+            return KWW_SUCCESS;
+        }
+    }
+    /* fall back to numeric integration */
+    s = kww_mid( w, beta, kind>0, kind==2, delta );
+    if ( s<0 ) {
+        *res = NAN;
+        return s;
+    }
+    *res = sign_out*s;
+    return KWW_SUCCESS;
+}
+
+int kwwc_e( const double w, const double beta, double* res )
+{
+    if ( !kww_beta_ok( beta ) ) {
+        *res = NAN;
+        return KWW_EDOM;
+    }
+    return kww_at( 0, res, w, beta,
+                   kwwc_lim_low( beta ), kwwc_lim_hig( beta ), NULL,
+                   kww_delta );
+}
+
+int kwws_e( const double w, const double beta, double* res )
+{
+    if ( !kww_beta_ok( beta ) ) {
+        *res = NAN;
+        return KWW_EDOM;
+    }
+    return kww_at( 1, res, w, beta,
+                   kwws_lim_low( beta ), kwws_lim_hig( beta ), NULL,
+                   kww_delta );
+}
+
+int kwwp_e( const double w, const double beta, double* res )
+{
+    if ( !kww_beta_ok( beta ) ) {
+        *res = NAN;
+        return KWW_EDOM;
+    }
+    return kww_at( 2, res, w, beta,
+                   kwwp_lim_low( beta ), kwwp_lim_hig( beta ), NULL,
+                   kww_delta );
+}
+
+
+/* Computes re = kwwc(w_in,beta) and im = kwws(w_in,beta) at once, sharing
+   work between the two. Status codes are returned in err[0], err[1].
+   Same expectations as kww_at, with range limits for kwwc, kwws in
+   lim_low[0..1] and lim_hig[0..1]. */
+static void kww_complex_at( double* re, double* im, int err[2],
+                            const double w_in, const double beta,
+                            const double lim_low[2], const double lim_hig[2],
+                            const kww_series_coef* coef, const double delta )
+{
+    double w;
+    Xdouble s[2] = { -1, -1 }; // negative: not yet computed, or failed
+    int regime[2];             // 0 low, 1 mid, 2 high
+    if ( isnan( w_in ) ) {
+        *re = *im = NAN;
+        err[0] = err[1] = KWW_EDOM;
+        return;
+    }
+    err[0] = err[1] = KWW_SUCCESS;
+    /* values at w=0 are well known */
+    if ( w_in==0 ) {
+        *re = tgamma(1.0/beta)/beta;
+        *im = 0;
+        return;
     }
-    /* it's an even function; the value at w=0 is well known */
-    if ( w_in==0 )
-        return tgamma(1.0/beta)/beta;
     w = fabs( w_in );
+    for ( int kind=0; kind<2; ++kind )
+        regime[kind] = w<lim_low[kind] ? 0 : w>lim_hig[kind] ? 2 : 1;
+    /* try series expansions, simultaneously if possible */
+    if      ( regime[0]==0 && regime[1]==0 )
+        kww_low_cs( w, beta, coef, delta, &s[0], &s[1] );
+    else if ( regime[0]==2 && regime[1]==2 )
+        kww_hig_cs( w, beta, coef, delta, &s[0], &s[1] );
+    else {
+        for ( int kind=0; kind<2; ++kind ) {
+            if      ( regime[kind]==0 )
+                s[kind] = kww_low( w, beta, kind, 0, coef, delta );
+            else if ( regime[kind]==2 )
+                s[kind] = kww_hig( w, beta, kind, 0, coef, delta );
+        }
+    }
     /* special case: Gaussian for b=2 */
     if ( beta==2 )
-        return sqrt(PI)/2*exp(-SQR((double)w)/4);
-    /* try series expansion */
-    if        ( w<kwwc_lim_low( beta ) ) {
-        Xdouble s = kwwc_low( w, beta );
-        if ( s>0 )
-            return s;
-        res = s;
-    } else if ( w>kwwc_lim_hig( beta ) ) {
-        Xdouble s = kwwc_hig( w, beta );
-        if ( s>0 )
-            return s;
-        res = s;
-    }
+        s[0] = sqrt(PI)/2*exp(-SQR((double)w)/4);
     /* fall back to numeric integration */
-    res = kwwc_mid( w, beta );
-    if ( res<0 ) {
-        if( beta>1.9 )
-            return 0; // must be tested by the user
-        // otherwise it ought to be considered a bug
-        fprintf( stderr, "kwwc: numeric integration failed for"
-                 " omega=%25.18g, beta=%25.18g; error code %g\n",
-                 w_in, beta, res );
-        exit( ENOSYS );
+    if      ( !(s[0]>0) && !(s[1]>0) )
+        kww_mid_cs( w, beta, delta, &s[0], &s[1] );
+    else if ( !(s[0]>0) )
+        s[0] = kww_mid( w, beta, 0, 0, delta );
+    else if ( !(s[1]>0) )
+        s[1] = kww_mid( w, beta, 1, 0, delta );
+    for ( int kind=0; kind<2; ++kind )
+        if ( s[kind]<0 )
+            err[kind] = s[kind];
+    *re = err[0] ? NAN : s[0];
+    *im = err[1] ? NAN : ( w_in<0 ? -s[1] : s[1] );
+}
+
+int kww_complex_e( const double w, const double beta, double* re, double* im )
+{
+    int err[2];
+    double lim_low[2], lim_hig[2];
+    if ( !kww_beta_ok( beta ) ) {
+        *re = *im = NAN;
+        return KWW_EDOM;
     }
-    return res;
+    lim_low[0] = kwwc_lim_low( beta );
+    lim_hig[0] = kwwc_lim_hig( beta );
+    lim_low[1] = kwws_lim_low( beta );
+    lim_hig[1] = kwws_lim_hig( beta );
+    kww_complex_at( re, im, err, w, beta, lim_low, lim_hig, NULL, kww_delta );
+    return err[0] ? err[0] : err[1];
 }
 
-/* \int_0^\infty dt sin(w*t) exp(-t^beta) */
-double kwws( const double w_in, const double beta )
+
+/* Computes s = kwws(w_in,beta) and p = kwwp(w_in,beta) at once, sharing
+   the numeric integration. Status codes are returned in err[0], err[1].
+   Same expectations as kww_at, with range limits for kwws, kwwp in
+   lim_low[1..2] and lim_hig[1..2]. */
+static void kww_sp_at( double* s, double* p, int err[2],
+                       const double w_in, const double beta,
+                       const double lim_low[3], const double lim_hig[3],
+                       const kww_series_coef* coef, const double delta )
 {
-    double w, res;
-    int sign_out;
-    /* check input data */
-    if ( beta<0.1 ) {
-        fprintf( stderr, "kww: beta smaller than 0.1\n" );
-        exit( EDOM );
+    double w;
+    Xdouble r[2] = { -1, -1 }; // negative: not yet computed, or failed
+    if ( isnan( w_in ) ) {
+        *s = *p = NAN;
+        err[0] = err[1] = KWW_EDOM;
+        return;
     }
-    if ( beta>2.0 ) {
-        fprintf( stderr, "kww: beta larger than 2.0\n" );
-        exit( EDOM );
+    err[0] = err[1] = KWW_SUCCESS;
+    /* both are odd functions */
+    if ( w_in==0 ) {
+        *s = *p = 0;
+        return;
     }
-    /* it's an odd function */
-    if ( w_in==0 )
-        return 0;
-    if ( w_in<0 ) {
-        w = - w_in;
-        sign_out = -1;
-    } else {
-        w = w_in;
-        sign_out = 1;
+    w = fabs( w_in );
+    /* try series expansions */
+    for ( int kind=1; kind<3; ++kind ) {
+        if      ( w<lim_low[kind] )
+            r[kind-1] = kww_low( w, beta, kind==1, kind==2, coef, delta );
+        else if ( w>lim_hig[kind] )
+            r[kind-1] = kind==2 ? kwwp_hig_coef( w, beta, coef, delta ) :
+                kww_hig( w, beta, 1, 0, coef, delta );
     }
-    /* try series expansion */
-    if        ( w<kwws_lim_low( beta ) ) {
-        Xdouble s = kwws_low( w, beta );
-        if ( s>0 )
-            return sign_out*s;
-        res = s;
-    } else if ( w>kwws_lim_hig( beta ) ) {
-        Xdouble s = kwws_hig( w, beta );
-        if ( s>0 )
-            return sign_out*s;
-        res = s;
+    /* fall back to numeric integration */
+    if      ( !(r[0]>0) && !(r[1]>0) )
+        kww_mid_sp( w, beta, delta, &r[0], &r[1] );
+    else if ( !(r[0]>0) )
+        r[0] = kww_mid( w, beta, 1, 0, delta );
+    else if ( !(r[1]>0) )
+        r[1] = kww_mid( w, beta, 1, 1, delta );
+    for ( int i=0; i<2; ++i )
+        if ( r[i]<0 )
+            err[i] = r[i];
+    *s = err[0] ? NAN : ( w_in<0 ? -r[0] : r[0] );
+    *p = err[1] ? NAN : ( w_in<0 ? -r[1] : r[1] );
+}
+
+static void sp_lims( const double beta, double lim_low[3], double lim_hig[3] )
+{
+    lim_low[0] = lim_hig[0] = 0; // unused
+    lim_low[1] = kwws_lim_low( beta );
+    lim_hig[1] = kwws_lim_hig( beta );
+    lim_low[2] = kwwp_lim_low( beta );
+    lim_hig[2] = kwwp_lim_hig( beta );
+}
+
+int kwwsp_e( const double w, const double beta, double* s, double* p )
+{
+    int err[2];
+    double lim_low[3], lim_hig[3];
+    if ( !kww_beta_ok( beta ) ) {
+        *s = *p = NAN;
+        return KWW_EDOM;
     }
+    sp_lims( beta, lim_low, lim_hig );
+    kww_sp_at( s, p, err, w, beta, lim_low, lim_hig, NULL, kww_delta );
+    return err[0] ? err[0] : err[1];
+}
+
+
+/* Computes *res = kwwc(w_in,beta), and its derivatives *dw by w and *db by
+   beta, sharing series coefficients or numeric integration. Returns
+   KWW_SUCCESS, or a negative error code with NaN in all three. Same
+   expectations as kww_at, with the range limits of kwwc; *res is the same
+   as from kww_at, and is taken from *known unless that is NULL. */
+static int kwwc_deriv_at( double* res, double* dw, double* db,
+                          const double w_in, const double beta,
+                          const double lim_low, const double lim_hig,
+                          const kww_series_coef* coef,
+                          const kww_deriv_coef* dcoef, const double delta,
+                          const double* known )
+{
+    double w;
+    Xdouble s = -1;   // negative: not yet computed, or failed
+    Xdouble d[2];     // w*dkwwc/dw, dkwwc/dbeta
+    int err = -1;     // nonzero: d not yet computed, or failed
+    if ( isnan( w_in ) ) {
+        *res = *dw = *db = NAN;
+        return KWW_EDOM;
+    }
+    w = fabs( w_in );
+    /* the derivatives of Gamma(1/beta)/beta are well known */
+    if ( w_in==0 ) {
+        const Xdouble a = 1/(Xdouble)beta;
+        *res = tgamma(1.0/beta)/beta;
+        *dw = 0;
+        *db = -*res/beta*( 1 + a*kww_psi( a ) );
+        return KWW_SUCCESS;
+    }
+    /* same choice of algorithm as in kww_at */
+    if      ( known )
+        s = *known;
+    else if ( beta==2 )
+        s = sqrt(PI)/2*exp(-SQR(w)/4);
+    else if ( w<lim_low )
+        s = kww_low( w, beta, 0, 0, coef, delta );
+    else if ( w>lim_hig )
+        s = kww_hig( w, beta, 0, 0, coef, delta );
+    if      ( w<lim_low )
+        err = kww_low_deriv( w, beta, coef, dcoef, delta, d );
+    else if ( w>lim_hig )
+        err = kww_hig_deriv( w, beta, coef, dcoef, delta, d );
     /* fall back to numeric integration */
-    res = kwws_mid( w, beta );
-    if ( res<0 ) {
-        fprintf( stderr, "kwws: numeric integration failed for"
-                 " omega=%25.18g, beta=%25.18g; error code %g\n",
-                 w_in, beta, res );
-        exit( ENOSYS );
+    if ( ( !(s>0) && beta!=2 ) || err ) {
+        Xdouble c;
+        Xdouble dm[2];
+        const int errm = kww_mid_deriv( w, beta, delta, &c, dm );
+        if ( !(s>0) && beta!=2 )
+            s = c;
+        if ( err ) {
+            err = errm;
+            d[0] = dm[0];
+            d[1] = dm[1];
+        }
+    }
+    if ( s<0 )
+        err = s;
+    if ( err ) {
+        *res = *dw = *db = NAN;
+        return err;
     }
-    return sign_out*res;
+    *res = s;
+    *dw = beta==2 ? -w_in/2*s : ( w_in<0 ? -d[0] : d[0] )/w;
+    *db = d[1];
+    return KWW_SUCCESS;
 }
 
-/* \int_0^w dw' \int_0^\infty dt cos(w'*t) exp(-t^beta) */
-double kwwp( const double w_in, const double beta )
+
+/*****************************************************************************/
+/*  High-level wrapper functions                                             */
+/*****************************************************************************/
+
+static void check_beta( const double beta )
 {
-    double w, res;
-    int sign_out;
-    /* check input data */
     if ( beta<0.1 ) {
         fprintf( stderr, "kww: beta smaller than 0.1\n" );
         exit( EDOM );
@@ -219,35 +442,630 @@ double kwwp( const double w_in, const double beta )
         fprintf( stderr, "kww: beta larger than 2.0\n" );
         exit( EDOM );
     }
-    /* it's an odd function */
-    if ( w_in==0 )
-        return 0;
-    if ( w_in<0 ) {
-        w = - w_in;
-        sign_out = -1;
+}
+
+/* Handles error code err of kww_at: either terminates the program,
+   or returns 0 in the range where kwwc is not fully supported. */
+static double kww_fail( const int kind, const double w, const double beta,
+                        const int err )
+{
+    if ( err==KWW_EDOM ) {
+        fprintf( stderr, "kww: omega is NaN\n" );
+        exit( EDOM );
+    }
+    if ( err==KWW_ENOMEM ) {
+        fprintf( stderr, "kww: Workspace allocation failed\n" );
+        exit( ENOMEM );
+    }
+    if ( kind==0 && beta>1.9 )
+        return 0; // must be tested by the user
+    // otherwise it ought to be considered a bug
+    fprintf( stderr, "kww%c: numeric integration failed for"
+             " omega=%25.18g, beta=%25.18g; error code %i\n",
+             kind_name[kind], w, beta, err );
+    exit( ENOSYS );
+}
+
+/* Returns result of kww_at, or terminates the program in case of error. */
+static double kww_or_exit( const int kind, const double w, const double beta,
+                           const double lim_low, const double lim_hig,
+                           const kww_series_coef* coef, const double delta )
+{
+    double res;
+    int err = kww_at( kind, &res, w, beta, lim_low, lim_hig, coef, delta );
+    if ( err )
+        return kww_fail( kind, w, beta, err );
+    return res;
+}
+
+static void kww_complex_or_exit( double* re, double* im,
+                                 const double w, const double beta,
+                                 const double lim_low[2],
+                                 const double lim_hig[2],
+                                 const kww_series_coef* coef,
+                                 const double delta )
+{
+    int err[2];
+    kww_complex_at( re, im, err, w, beta, lim_low, lim_hig, coef, delta );
+    if ( err[0] )
+        *re = kww_fail( 0, w, beta, err[0] );
+    if ( err[1] )
+        *im = kww_fail( 1, w, beta, err[1] );
+}
+
+/* \int_0^\infty dt cos(w*t) exp(-t^beta) */
+double kwwc( const double w, const double beta )
+{
+    check_beta( beta );
+    return kww_or_exit( 0, w, beta,
+                        kwwc_lim_low( beta ), kwwc_lim_hig( beta ), NULL,
+                        kww_delta );
+}
+
+/* \int_0^\infty dt sin(w*t) exp(-t^beta) */
+double kwws( const double w, const double beta )
+{
+    check_beta( beta );
+    return kww_or_exit( 1, w, beta,
+                        kwws_lim_low( beta ), kwws_lim_hig( beta ), NULL,
+                        kww_delta );
+}
+
+/* \int_0^w dw' \int_0^\infty dt cos(w'*t) exp(-t^beta) */
+double kwwp( const double w, const double beta )
+{
+    check_beta( beta );
+    return kww_or_exit( 2, w, beta,
+                        kwwp_lim_low( beta ), kwwp_lim_hig( beta ), NULL,
+                        kww_delta );
+}
+
+
+/* kwwc and kwws at once */
+void kww_complex( const double w, const double beta, double* re, double* im )
+{
+    double lim_low[2], lim_hig[2];
+    check_beta( beta );
+    lim_low[0] = kwwc_lim_low( beta );
+    lim_hig[0] = kwwc_lim_hig( beta );
+    lim_low[1] = kwws_lim_low( beta );
+    lim_hig[1] = kwws_lim_hig( beta );
+    kww_complex_or_exit( re, im, w, beta, lim_low, lim_hig, NULL, kww_delta );
+}
+
+
+/* kwws and kwwp at once */
+void kwwsp( const double w, const double beta, double* s, double* p )
+{
+    int err[2];
+    double lim_low[3], lim_hig[3];
+    check_beta( beta );
+    sp_lims( beta, lim_low, lim_hig );
+    kww_sp_at( s, p, err, w, beta, lim_low, lim_hig, NULL, kww_delta );
+    if ( err[0] )
+        *s = kww_fail( 1, w, beta, err[0] );
+    if ( err[1] )
+        *p = kww_fail( 2, w, beta, err[1] );
+}
+
+
+/*****************************************************************************/
+/*  Lifecycle                                                                */
+/*****************************************************************************/
+
+int kww_init( const kww_init_options* options )
+{
+    double beta_min = 0.1;
+    double beta_max = 2.0;
+    int niter = KWW_INIT_NITER;
+    if ( options ) {
+        if ( options->beta_min || options->beta_max ) {
+            beta_min = options->beta_min;
+            beta_max = options->beta_max;
+        }
+        if ( options->niter )
+            niter = options->niter;
+    }
+    if ( !kww_beta_ok( beta_min ) || !kww_beta_ok( beta_max ) ||
+         beta_min>beta_max )
+        return KWW_EDOM;
+    return kww_mid_tables_init( beta_min, beta_max, niter );
+}
+
+void kww_finalize( void )
+{
+    kww_mid_tables_free();
+}
+
+/*****************************************************************************/
+/*  Batch evaluation, shared by plan and array calls                         */
+/*****************************************************************************/
+
+/* What a batch computes: kwwc, kwws, kwwp as in kww_at, or two at once,
+   or kwwc with its derivatives */
+#define BATCH_COMPLEX 3
+#define BATCH_SP 4
+#define BATCH_DERIV 5
+
+/* Evaluations with common beta. Range limits are indexed by kind 0..2. */
+typedef struct {
+    int what;
+    double beta;
+    const double* lim_low;
+    const double* lim_hig;
+    const kww_series_coef* coef; // or NULL
+    const kww_deriv_coef* dcoef; // or NULL; for BATCH_DERIV, requires coef
+    double delta;                // relative tolerance
+    const double* w;
+    double* out[3];              // second output for BATCH_COMPLEX, BATCH_SP;
+                                 //   second and third for BATCH_DERIV
+    int* status;                 // or NULL
+    const char* done;            // or NULL; points done in block passes
+                                 //   or kww_batch_mid; for BATCH_DERIV,
+                                 //   points where val holds kwwc
+    const double* val;           // or NULL; for BATCH_DERIV
+} kww_batch;
+
+/* Evaluates point i of batch ctx; returns status code. */
+static int kww_batch_at( void* ctx, const size_t row, const size_t i )
+{
+    const kww_batch* B = ctx;
+    int ret, err[2];
+    (void)row;
+    if      ( B->what==BATCH_DERIV )
+        ret = kwwc_deriv_at( &B->out[0][i], &B->out[1][i], &B->out[2][i],
+                             B->w[i], B->beta, B->lim_low[0], B->lim_hig[0],
+                             B->coef, B->dcoef, B->delta,
+                             B->done && B->done[i] ? &B->val[i] : NULL );
+    else if ( B->done && B->done[i] )
+        ret = KWW_SUCCESS;
+    else if ( B->what==BATCH_COMPLEX ) {
+        kww_complex_at( &B->out[0][i], &B->out[1][i], err, B->w[i], B->beta,
+                        B->lim_low, B->lim_hig, B->coef, B->delta );
+        ret = err[0] ? err[0] : err[1];
+    } else if ( B->what==BATCH_SP ) {
+        kww_sp_at( &B->out[0][i], &B->out[1][i], err, B->w[i], B->beta,
+                   B->lim_low, B->lim_hig, B->coef, B->delta );
+        ret = err[0] ? err[0] : err[1];
+    } else
+        ret = kww_at( B->what, &B->out[0][i], B->w[i], B->beta,
+                      B->lim_low[B->what], B->lim_hig[B->what], B->coef,
+                      B->delta );
+    if ( B->status )
+        B->status[i] = ret;
+    return ret;
+}
+
+/* Runs batch B on n points, in parallel if worthwhile.
+   Returns the number of failed evaluations. */
+static size_t kww_batch_e( const kww_batch* B, const size_t n )
+{
+    // limits that determine the cost of an evaluation
+    const int k0 = B->what==BATCH_SP ? 1 : B->what>2 ? 0 : B->what;
+    const int nlim = B->what==BATCH_COMPLEX || B->what==BATCH_SP ? 2 : 1;
+    kww_batch C = *B;
+    char* done = NULL;
+    size_t nfail;
+    // series expansions and numeric integration block-wise, where all
+    // points have the same kind, and coefficients are precomputed
+    if ( B->what<=2 && B->coef && ( done = calloc( n, 1 ) ) ) {
+        kww_batch_series( B->what, B->w, n, B->beta, B->lim_low[B->what],
+                          B->lim_hig[B->what], B->coef, B->delta,
+                          B->out[0], done );
+        kww_batch_mid( B->what, B->w, n, B->beta, B->delta, B->out[0], done );
+        C.done = done;
+    }
+    nfail = kww_batch_run( B->w, n, 1, nlim, B->lim_low+k0, B->lim_hig+k0,
+                           kww_batch_at, &C );
+    free( done );
+    return nfail;
+}
+
+/* Same, but terminates the program in case of error. Worker threads
+   only store NaN; failed points are then redone sequentially in order to
+   report them, or to obtain 0 where kwwc is not fully supported. In place,
+   the redo needs a copy of w, taken before any result is stored. */
+static void kww_batch_or_exit( const kww_batch* B, const size_t n )
+{
+    kww_batch C = *B;
+    double* w = NULL;
+    if ( n && ( B->out[0]==B->w || B->out[1]==B->w ) ) {
+        if ( !( w = malloc( n*sizeof(double) ) ) )
+            kww_fail( B->what<=2 ? B->what : 0, 0, B->beta, KWW_ENOMEM );
+        memcpy( w, B->w, n*sizeof(double) );
+        C.w = w;
+    }
+    if ( kww_batch_e( &C, n ) ) {
+        for ( size_t i=0; i<n; ++i ) {
+            if ( B->what==BATCH_COMPLEX ) {
+                if ( isnan( B->out[0][i] ) || isnan( B->out[1][i] ) )
+                    kww_complex_or_exit( &B->out[0][i], &B->out[1][i],
+                                         C.w[i], B->beta, B->lim_low,
+                                         B->lim_hig, B->coef, B->delta );
+            } else if ( isnan( B->out[0][i] ) )
+                B->out[0][i] = kww_or_exit( B->what, C.w[i], B->beta,
+                                            B->lim_low[B->what],
+                                            B->lim_hig[B->what], B->coef,
+                                            B->delta );
+        }
+    }
+    free( w );
+}
+
+/* Sets up B for given beta, with limits stored in lim_low, lim_hig, and
+   with coefficients from plan, or computed on the fly if plan is NULL. */
+static void kww_batch_init( kww_batch* B, const int what, const double beta,
+                            const kww_plan* plan,
+                            double lim_low[3], double lim_hig[3],
+                            const double* w, double* out0, double* out1,
+                            int* status )
+{
+    B->what = what;
+    B->beta = beta;
+    if ( plan ) {
+        B->lim_low = plan->lim_low;
+        B->lim_hig = plan->lim_hig;
+        B->coef = &plan->coef;
+        B->delta = plan->delta;
     } else {
-        w = w_in;
-        sign_out = 1;
+        lim_low[0] = kwwc_lim_low( beta );
+        lim_hig[0] = kwwc_lim_hig( beta );
+        lim_low[1] = kwws_lim_low( beta );
+        lim_hig[1] = kwws_lim_hig( beta );
+        lim_low[2] = kwwp_lim_low( beta );
+        lim_hig[2] = kwwp_lim_hig( beta );
+        B->lim_low = lim_low;
+        B->lim_hig = lim_hig;
+        B->coef = NULL;
+        B->delta = kww_delta;
     }
-    /* try series expansions */
-    if        ( w<kwwp_lim_low( beta ) ) {
-        Xdouble s = kwwp_low( w, beta );
-        if ( s>0 )
-            return sign_out*s;
-        res = s;
-    } else if ( w>kwwp_lim_hig( beta ) ) {
-        Xdouble s = kwwp_hig( w, beta );
-        if ( s>0 )
-            return sign_out*s;
-        res = s;
+    B->w = w;
+    B->out[0] = out0;
+    B->out[1] = out1;
+    B->out[2] = NULL;
+    B->dcoef = NULL;
+    B->val = NULL;
+    B->status = status;
+    B->done = NULL;
+}
+
+
+/*****************************************************************************/
+/*  Plans: beta-dependent setup, done once for many calls                    */
+/*****************************************************************************/
+
+kww_plan* kww_plan_create( const double beta )
+{
+    kww_plan* plan;
+    if ( !kww_beta_ok( beta ) )
+        return NULL;
+    if ( !( plan = malloc( sizeof(kww_plan) ) ) )
+        return NULL;
+    plan->beta = beta;
+    plan->delta = kww_delta;
+    plan->lim_low[0] = kwwc_lim_low( beta );
+    plan->lim_hig[0] = kwwc_lim_hig( beta );
+    plan->lim_low[1] = kwws_lim_low( beta );
+    plan->lim_hig[1] = kwws_lim_hig( beta );
+    plan->lim_low[2] = kwwp_lim_low( beta );
+    plan->lim_hig[2] = kwwp_lim_hig( beta );
+    kww_series_coef_init( &plan->coef, beta );
+    return plan;
+}
+
+void kww_plan_destroy( kww_plan* plan )
+{
+    free( plan );
+}
+
+double kww_plan_beta( const kww_plan* plan )
+{
+    return plan->beta;
+}
+
+int kww_plan_set_tol( kww_plan* plan, const double tol )
+{
+    if ( !( tol>=KWW_TOL_MIN && tol<=KWW_TOL_MAX ) )
+        return KWW_EDOM;
+    plan->delta = tol;
+    return KWW_SUCCESS;
+}
+
+double kww_plan_tol( const kww_plan* plan )
+{
+    return plan->delta;
+}
+
+static int kww_plan_at( const int kind, const kww_plan* plan, const double w,
+                        double* res )
+{
+    return kww_at( kind, res, w, plan->beta,
+                   plan->lim_low[kind], plan->lim_hig[kind], &plan->coef,
+                   plan->delta );
+}
+
+/* Returns the number of failed evaluations. status may be NULL. */
+static size_t kww_plan_array_e( const int what, const kww_plan* plan,
+                                const double* w, const size_t n,
+                                double* out0, double* out1, int* status )
+{
+    kww_batch B;
+    kww_batch_init( &B, what, plan->beta, plan, NULL, NULL,
+                    w, out0, out1, status );
+    return kww_batch_e( &B, n );
+}
+
+static void kww_plan_array_or_exit( const int what, const kww_plan* plan,
+                                    const double* w, const size_t n,
+                                    double* out0, double* out1 )
+{
+    kww_batch B;
+    kww_batch_init( &B, what, plan->beta, plan, NULL, NULL,
+                    w, out0, out1, NULL );
+    kww_batch_or_exit( &B, n );
+}
+double kwwc_plan( const kww_plan* plan, const double w )
+{
+    return kww_or_exit( 0, w, plan->beta, plan->lim_low[0], plan->lim_hig[0],
+                        &plan->coef, plan->delta );
+}
+
+double kwws_plan( const kww_plan* plan, const double w )
+{
+    return kww_or_exit( 1, w, plan->beta, plan->lim_low[1], plan->lim_hig[1],
+                        &plan->coef, plan->delta );
+}
+
+double kwwp_plan( const kww_plan* plan, const double w )
+{
+    return kww_or_exit( 2, w, plan->beta, plan->lim_low[2], plan->lim_hig[2],
+                        &plan->coef, plan->delta );
+}
+
+int kwwc_plan_e( const kww_plan* plan, const double w, double* res )
+{
+    return kww_plan_at( 0, plan, w, res );
+}
+
+int kwws_plan_e( const kww_plan* plan, const double w, double* res )
+{
+    return kww_plan_at( 1, plan, w, res );
+}
+
+int kwwp_plan_e( const kww_plan* plan, const double w, double* res )
+{
+    return kww_plan_at( 2, plan, w, res );
+}
+
+void kwwc_plan_array( const kww_plan* plan, const double* w, const size_t n,
+                      double* out )
+{
+    kww_plan_array_or_exit( 0, plan, w, n, out, NULL );
+}
+
+void kwws_plan_array( const kww_plan* plan, const double* w, const size_t n,
+                      double* out )
+{
+    kww_plan_array_or_exit( 1, plan, w, n, out, NULL );
+}
+
+void kwwp_plan_array( const kww_plan* plan, const double* w, const size_t n,
+                      double* out )
+{
+    kww_plan_array_or_exit( 2, plan, w, n, out, NULL );
+}
+
+size_t kwwc_plan_array_e( const kww_plan* plan, const double* w,
+                          const size_t n, double* out, int* status )
+{
+    return kww_plan_array_e( 0, plan, w, n, out, NULL, status );
+}
+
+size_t kwws_plan_array_e( const kww_plan* plan, const double* w,
+                          const size_t n, double* out, int* status )
+{
+    return kww_plan_array_e( 1, plan, w, n, out, NULL, status );
+}
+
+size_t kwwp_plan_array_e( const kww_plan* plan, const double* w,
+                          const size_t n, double* out, int* status )
+{
+    return kww_plan_array_e( 2, plan, w, n, out, NULL, status );
+}
+
+
+void kww_complex_plan_array( const kww_plan* plan, const double* w,
+                             const size_t n, double* re, double* im )
+{
+    kww_plan_array_or_exit( BATCH_COMPLEX, plan, w, n, re, im );
+}
+
+size_t kww_complex_plan_array_e( const kww_plan* plan, const double* w,
+                                 const size_t n, double* re, double* im,
+                                 int* status )
+{
+    return kww_plan_array_e( BATCH_COMPLEX, plan, w, n, re, im, status );
+}
+
+
+/*****************************************************************************/
+/*  Array versions: beta-dependent setup is done only once                   */
+/*****************************************************************************/
+
+/* Array with one or two outputs, terminating the program in case of error */
+static void kww_array( const int what, const double* w, const size_t n,
+                       const double beta, double* out0, double* out1 )
+{
+    kww_batch B;
+    double lim_low[3], lim_hig[3];
+    check_beta( beta );
+    kww_plan* plan = n>=KWW_PLAN_MIN_SIZE ? kww_plan_create( beta ) : NULL;
+    kww_batch_init( &B, what, beta, plan, lim_low, lim_hig,
+                    w, out0, out1, NULL );
+    kww_batch_or_exit( &B, n );
+    kww_plan_destroy( plan );
+}
+
+/* Same, with status code, returning the number of failed evaluations */
+static size_t kww_array_e( const int what, const double* w, const size_t n,
+                           const double beta, double* out0, double* out1,
+                           int* status )
+{
+    kww_batch B;
+    double lim_low[3], lim_hig[3];
+    size_t nfail;
+    if ( !kww_beta_ok( beta ) ) {
+        for ( size_t i=0; i<n; ++i ) {
+            out0[i] = NAN;
+            if ( out1 )
+                out1[i] = NAN;
+            if ( status )
+                status[i] = KWW_EDOM;
+        }
+        return n;
     }
-    /* fall back to numeric integration */
-    res = kwwp_mid( w, beta );
-    if ( res<0 ) {
-        fprintf( stderr, "kwwp: numeric integration failed for"
-                 " omega=%25.18g, beta=%25.18g; error code %g\n",
-                 w_in, beta, res );
-        exit( ENOSYS );
-    }
-    return sign_out*res;
+    kww_plan* plan = n>=KWW_PLAN_MIN_SIZE ? kww_plan_create( beta ) : NULL;
+    kww_batch_init( &B, what, beta, plan, lim_low, lim_hig,
+                    w, out0, out1, status );
+    nfail = kww_batch_e( &B, n );
+    kww_plan_destroy( plan );
+    return nfail;
+}
+
+void kwwc_array( const double* w, const size_t n, const double beta,
+                 double* out )
+{
+    kww_array( 0, w, n, beta, out, NULL );
+}
+
+void kwws_array( const double* w, const size_t n, const double beta,
+                 double* out )
+{
+    kww_array( 1, w, n, beta, out, NULL );
+}
+
+void kwwp_array( const double* w, const size_t n, const double beta,
+                 double* out )
+{
+    kww_array( 2, w, n, beta, out, NULL );
+}
+
+size_t kwwc_array_e( const double* w, const size_t n, const double beta,
+                     double* out, int* status )
+{
+    return kww_array_e( 0, w, n, beta, out, NULL, status );
+}
+
+size_t kwws_array_e( const double* w, const size_t n, const double beta,
+                     double* out, int* status )
+{
+    return kww_array_e( 1, w, n, beta, out, NULL, status );
+}
+
+size_t kwwp_array_e( const double* w, const size_t n, const double beta,
+                     double* out, int* status )
+{
+    return kww_array_e( 2, w, n, beta, out, NULL, status );
+}
+
+void kww_complex_array( const double* w, const size_t n, const double beta,
+                        double* re, double* im )
+{
+    kww_array( BATCH_COMPLEX, w, n, beta, re, im );
+}
+
+size_t kww_complex_array_e( const double* w, const size_t n,
+                            const double beta, double* re, double* im,
+                            int* status )
+{
+    return kww_array_e( BATCH_COMPLEX, w, n, beta, re, im, status );
+}
+
+size_t kwwsp_array_e( const double* w, const size_t n, const double beta,
+                      double* s, double* p, int* status )
+{
+    return kww_array_e( BATCH_SP, w, n, beta, s, p, status );
+}
+
+
+/*****************************************************************************/
+/*  Derivatives of kwwc, for fits                                            */
+/*****************************************************************************/
+
+int kwwc_deriv_e( const double w, const double beta,
+                  double* res, double* dw, double* db )
+{
+    if ( !kww_beta_ok( beta ) ) {
+        *res = *dw = *db = NAN;
+        return KWW_EDOM;
+    }
+    return kwwc_deriv_at( res, dw, db, w, beta,
+                          kwwc_lim_low( beta ), kwwc_lim_hig( beta ), NULL,
+                          NULL, kww_delta, NULL );
+}
+
+/* Runs batch B of BATCH_DERIV. If there are enough points to amortize
+   them, computes coefficients for the series of the derivatives, and
+   kwwc in the series ranges block-wise beforehand. The latter go to a
+   buffer of their own, since the outputs may be the same array as w. */
+static size_t kww_deriv_batch_e( kww_batch* B, const size_t n )
+{
+    kww_deriv_coef* dcoef = NULL;
+    char* done = NULL;
+    double* val = NULL;
+    size_t nfail;
+    // without memory, terms and values are computed point by point
+    if ( B->coef && n>=KWW_PLAN_MIN_SIZE &&
+         ( dcoef = malloc( sizeof(kww_deriv_coef) ) ) ) {
+        kww_deriv_coef_init( dcoef, B->coef, B->beta );
+        if ( ( done = calloc( n, 1 ) ) && ( val = malloc( n*sizeof(double) ) ) )
+            kww_batch_series( 0, B->w, n, B->beta, B->lim_low[0],
+                              B->lim_hig[0], B->coef, B->delta, val, done );
+        else {
+            free( done );
+            done = NULL;
+        }
+    }
+    B->dcoef = dcoef;
+    B->done = done;
+    B->val = val;
+    nfail = kww_batch_e( B, n );
+    free( val );
+    free( done );
+    free( dcoef );
+    return nfail;
+}
+
+size_t kwwc_deriv_plan_array_e( const kww_plan* plan, const double* w,
+                                const size_t n, double* res, double* dw,
+                                double* db, int* status )
+{
+    kww_batch B;
+    kww_batch_init( &B, BATCH_DERIV, plan->beta, plan, NULL, NULL,
+                    w, res, dw, status );
+    B.out[2] = db;
+    return kww_deriv_batch_e( &B, n );
+}
+
+size_t kwwc_deriv_array_e( const double* w, const size_t n, const double beta,
+                           double* res, double* dw, double* db, int* status )
+{
+    kww_batch B;
+    double lim_low[3], lim_hig[3];
+    size_t nfail;
+    if ( !kww_beta_ok( beta ) ) {
+        for ( size_t i=0; i<n; ++i ) {
+            res[i] = dw[i] = db[i] = NAN;
+            if ( status )
+                status[i] = KWW_EDOM;
+        }
+        return n;
+    }
+    kww_plan* plan = n>=KWW_PLAN_MIN_SIZE ? kww_plan_create( beta ) : NULL;
+    kww_batch_init( &B, BATCH_DERIV, beta, plan, lim_low, lim_hig,
+                    w, res, dw, status );
+    B.out[2] = db;
+    nfail = kww_deriv_batch_e( &B, n );
+    kww_plan_destroy( plan );
+    return nfail;
 }
@@ -35,6 +35,9 @@
 
 #ifndef __KWW_H__
 #define __KWW_H__
+
+#include <stddef.h>
+
 #undef __BEGIN_DECLS
 #undef __END_DECLS
 #ifdef __cplusplus
@@ -67,6 +70,209 @@ KWW_EXPORT double kwws( const double w, const double beta );
 /* \int_0^w dw' kwwc(w') */
 KWW_EXPORT double kwwp( const double w, const double beta );
 
+/* re = kwwc(w, beta), im = kwws(w, beta), computed together */
+KWW_EXPORT void kww_complex( const double w, const double beta,
+                             double* re, double* im );
+
+/* s = kwws(w, beta), p = kwwp(w, beta), computed together */
+KWW_EXPORT void kwwsp( const double w, const double beta,
+                       double* s, double* p );
+
+
+/*****************************************************************************/
+/*  Calls with status code, for use in long batch runs                       */
+/*****************************************************************************/
+
+/* Status codes. Negative codes -2..-9 are passed on from low-level calls:
+   -2, -6: cancellation; -3, -5: overflow; -4, -7: underflow;
+   -8: invalid result; -9: no convergence. */
+#define KWW_SUCCESS 0
+#define KWW_EDOM -10   /* beta out of range, or omega is NaN */
+#define KWW_ENOMEM -11 /* workspace allocation failed */
+
+/* These never terminate the program. They return a status code, and
+   store the function value in *res, or NaN in case of error. */
+KWW_EXPORT int kwwc_e( const double w, const double beta, double* res );
+KWW_EXPORT int kwws_e( const double w, const double beta, double* res );
+KWW_EXPORT int kwwp_e( const double w, const double beta, double* res );
+KWW_EXPORT int kww_complex_e( const double w, const double beta,
+                              double* re, double* im );
+KWW_EXPORT int kwwsp_e( const double w, const double beta,
+                        double* s, double* p );
+
+
+/*****************************************************************************/
+/*  Array calls: out[i] = kww?(w[i], beta) for i=0..n-1                      */
+/*****************************************************************************/
+
+/* In all array calls, with or without _e or plan, an output array (out, or
+   one of re, im or s, p) may be the same array as w, for in-place
+   evaluation; otherwise, outputs must not overlap w. */
+KWW_EXPORT void kwwc_array( const double* w, const size_t n, const double beta,
+                            double* out );
+KWW_EXPORT void kwws_array( const double* w, const size_t n, const double beta,
+                            double* out );
+KWW_EXPORT void kwwp_array( const double* w, const size_t n, const double beta,
+                            double* out );
+
+/* With status code per element (status may be NULL), as in kwwc_e etc.
+   Return the number of failed evaluations. */
+KWW_EXPORT size_t kwwc_array_e( const double* w, const size_t n,
+                                const double beta, double* out, int* status );
+KWW_EXPORT size_t kwws_array_e( const double* w, const size_t n,
+                                const double beta, double* out, int* status );
+KWW_EXPORT size_t kwwp_array_e( const double* w, const size_t n,
+                                const double beta, double* out, int* status );
+
+/* re[i] = kwwc(w[i], beta), im[i] = kwws(w[i], beta) */
+KWW_EXPORT void kww_complex_array( const double* w, const size_t n,
+                                   const double beta, double* re, double* im );
+KWW_EXPORT size_t kww_complex_array_e( const double* w, const size_t n,
+                                       const double beta, double* re,
+                                       double* im, int* status );
+
+/* s[i] = kwws(w[i], beta), p[i] = kwwp(w[i], beta) */
+KWW_EXPORT size_t kwwsp_array_e( const double* w, const size_t n,
+                                 const double beta, double* s, double* p,
+                                 int* status );
+
+
+/*****************************************************************************/
+/*  Plans: beta-dependent series coefficients, computed once for many calls  */
+/*****************************************************************************/
+
+typedef struct kww_plan kww_plan;
+
+/* returns NULL if beta is out of range or allocation fails */
+KWW_EXPORT kww_plan* kww_plan_create( const double beta );
+KWW_EXPORT void kww_plan_destroy( kww_plan* plan );
+KWW_EXPORT double kww_plan_beta( const kww_plan* plan );
+
+/* Relative tolerance. By default, calls aim at full double precision,
+   tol=KWW_TOL_MIN. A larger tol saves terms of the series expansions
+   and iterations of the numeric integration. Returns KWW_EDOM, and leaves
+   the plan unchanged, unless KWW_TOL_MIN <= tol <= KWW_TOL_MAX. */
+#define KWW_TOL_MIN 2.2e-16
+#define KWW_TOL_MAX 1e-2
+KWW_EXPORT int kww_plan_set_tol( kww_plan* plan, const double tol );
+KWW_EXPORT double kww_plan_tol( const kww_plan* plan );
+
+/* same as kwwc(w, beta) etc, with beta from plan */
+KWW_EXPORT double kwwc_plan( const kww_plan* plan, const double w );
+KWW_EXPORT double kwws_plan( const kww_plan* plan, const double w );
+KWW_EXPORT double kwwp_plan( const kww_plan* plan, const double w );
+
+KWW_EXPORT void kwwc_plan_array( const kww_plan* plan, const double* w,
+                                 const size_t n, double* out );
+KWW_EXPORT void kwws_plan_array( const kww_plan* plan, const double* w,
+                                 const size_t n, double* out );
+KWW_EXPORT void kwwp_plan_array( const kww_plan* plan, const double* w,
+                                 const size_t n, double* out );
+
+/* with status code, as in kwwc_e and kwwc_array_e */
+KWW_EXPORT int kwwc_plan_e( const kww_plan* plan, const double w, double* res );
+KWW_EXPORT int kwws_plan_e( const kww_plan* plan, const double w, double* res );
+KWW_EXPORT int kwwp_plan_e( const kww_plan* plan, const double w, double* res );
+KWW_EXPORT size_t kwwc_plan_array_e( const kww_plan* plan, const double* w,
+                                     const size_t n, double* out, int* status );
+KWW_EXPORT size_t kwws_plan_array_e( const kww_plan* plan, const double* w,
+                                     const size_t n, double* out, int* status );
+KWW_EXPORT size_t kwwp_plan_array_e( const kww_plan* plan, const double* w,
+                                     const size_t n, double* out, int* status );
+KWW_EXPORT void kww_complex_plan_array( const kww_plan* plan, const double* w,
+                                        const size_t n, double* re,
+                                        double* im );
+KWW_EXPORT size_t kww_complex_plan_array_e( const kww_plan* plan,
+                                            const double* w, const size_t n,
+                                            double* re, double* im,
+                                            int* status );
+
+
+/*****************************************************************************/
+/*  Derivatives of kwwc, for fits                                            */
+/*****************************************************************************/
+
+/* res = kwwc(w, beta), dw = d kwwc/dw, db = d kwwc/dbeta, computed together
+   from the same series coefficients or integrand. w*dw and db are accurate
+   to the tolerance relative to the larger of their magnitude and kwwc.
+   Status codes as in kwwc_e, kwwc_array_e, with NaN in all three outputs
+   in case of error. One of res, dw, db may be the same array as w. */
+KWW_EXPORT int kwwc_deriv_e( const double w, const double beta,
+                             double* res, double* dw, double* db );
+KWW_EXPORT size_t kwwc_deriv_array_e( const double* w, const size_t n,
+                                      const double beta, double* res,
+                                      double* dw, double* db, int* status );
+KWW_EXPORT size_t kwwc_deriv_plan_array_e( const kww_plan* plan,
+                                           const double* w, const size_t n,
+                                           double* res, double* dw,
+                                           double* db, int* status );
+
+
+/*****************************************************************************/
+/*  Grids: out[j*nw+i] = kww?(w[i], beta[j])                                 */
+/*****************************************************************************/
+
+/* Selects the function in grid calls */
+#define KWW_C 0 /* kwwc */
+#define KWW_S 1 /* kwws */
+#define KWW_P 2 /* kwwp */
+
+/* Rows (one per beta) are computed in parallel if built with OpenMP.
+   Never terminates the program; failed evaluations, including those with
+   beta out of range, yield NaN. Returns the number of failed evaluations. */
+KWW_EXPORT size_t kww_grid( const int kind, const double* w, const size_t nw,
+                            const double* beta, const size_t nb, double* out );
+
+
+/*****************************************************************************/
+/*  Surrogates: fast approximation, built once per beta                      */
+/*****************************************************************************/
+
+typedef struct kww_surrogate kww_surrogate;
+
+/* Tabulates kwwc (kind=KWW_C) etc as piecewise Chebyshev expansions in
+   log(omega), in the range where numeric integration would be needed,
+   aiming at relative accuracy tol (about 1e-10 is a sensible choice).
+   Outside this range, the series expansions are used as in kwwc etc.
+   The maximum relative error, as found by comparison with the exact
+   function between the nodes, is stored in *err (unless err is NULL).
+   Returns NULL if kind or beta is out of range, if the exact function
+   fails to converge, or if allocation fails. */
+KWW_EXPORT kww_surrogate* kww_surrogate_create( const int kind,
+                                                const double beta,
+                                                const double tol,
+                                                double* err );
+KWW_EXPORT void kww_surrogate_destroy( kww_surrogate* sur );
+KWW_EXPORT double kww_surrogate_err( const kww_surrogate* sur );
+
+/* Approximate kww?(omega, beta). Returns NaN if omega is NaN, or if
+   a series expansion fails. */
+KWW_EXPORT double kww_surrogate_eval( const kww_surrogate* sur,
+                                      const double w );
+KWW_EXPORT void kww_surrogate_array( const kww_surrogate* sur,
+                                     const double* w, const size_t n,
+                                     double* out );
+
+
+/*****************************************************************************/
+/*  Lifecycle: optional setup and release of the integration tables          */
+/*****************************************************************************/
+
+/* Otherwise, tables are built when first needed, and kept until exit */
+typedef struct {
+    double beta_min;  /* tables for beta_min <= beta <= beta_max; */
+    double beta_max;  /*   both 0 for the full range 0.1..2.0 */
+    int niter;        /* iterations 1..12 of the numeric integration;
+                         0 for KWW_INIT_NITER */
+} kww_init_options;
+#define KWW_INIT_NITER 6
+
+/* Builds the tables up front; options may be NULL for the defaults.
+   Returns KWW_SUCCESS, KWW_EDOM for invalid options, or KWW_ENOMEM. */
+KWW_EXPORT int kww_init( const kww_init_options* options );
+/* Releases the tables; later calls build them again as needed.
+   Must not run concurrently with any other call. */
+KWW_EXPORT void kww_finalize( void );
 
 /*****************************************************************************/
 /*  Low-level calls                                                          */
@@ -0,0 +1,36 @@
+/* kww_avx512.c:
+ *   Vectorized trapezoid sums of kww_mid, and series expansions of kww_low
+ *   and kww_hig, compiled with -mavx512f.
+ *
+ * Copyright:
+ *   (C) 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ */
+
+#define KWW_SIMD_WIDTH 8
+#define KWW_MID_SIMD_NAME kww_mid_sum_avx512
+#define KWW_SERIES_SIMD_NAME kww_series_avx512
+#include "kww_mid_simd.c"
+#include "kww_series_simd.c"
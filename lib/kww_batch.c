@@ -0,0 +1,337 @@
+/* kww_batch.c:
+ *   Batch evaluation over grids of frequencies and stretching exponents.
+ *
+ * Copyright:
+ *   (C) 2009, 2012, 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ *
+ * Reference:
+ *   Wuttke, Algorithms 5, 604-628 (2012), doi:10.3390/a5040604
+ */
+
+
+
+#include <stdlib.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "kww.h"
+#include "kww_plan.h"
+
+/*****************************************************************************/
+/*  Scheduling                                                               */
+/*****************************************************************************/
+
+/* Predicted costs, in units of one series evaluation. Numeric integration
+   takes 30 to 400 times longer than a series, depending on beta. */
+#define COST_SERIES 1
+#define COST_MID 64
+
+/* Number of chunks per thread: enough to balance load, few enough to keep
+   the scheduling overhead small. */
+#define CHUNKS_PER_THREAD 16
+
+/* Whether evaluation of point i of row j needs numeric integration */
+static int is_mid( const double* w, const size_t n, const int nlim,
+                   const double* lim_low, const double* lim_hig,
+                   const size_t ij )
+{
+    const size_t j = ij/n;
+    const double wa = fabs( w[ij%n] );
+    for ( int k=0; k<nlim; ++k )
+        if ( wa>=lim_low[j*nlim+k] && wa<=lim_hig[j*nlim+k] )
+            return 1;
+    return 0;
+}
+
+size_t kww_batch_run( const double* w, const size_t n, const size_t nrow,
+                      const int nlim,
+                      const double* lim_low, const double* lim_hig,
+                      kww_batch_eval* eval, void* ctx )
+{
+    const size_t ntot = n*nrow;
+    size_t nfail = 0;
+    int nthreads = 1;
+#ifdef _OPENMP
+    if ( !omp_in_parallel() )
+        nthreads = omp_get_max_threads();
+#endif
+    size_t* order = nthreads>1 && ntot>1 ? malloc( ntot*sizeof(size_t) ) :
+        NULL;
+    if ( !order ) {
+        for ( size_t ij=0; ij<ntot; ++ij )
+            if ( eval( ctx, ij/n, ij%n ) )
+                ++nfail;
+        return nfail;
+    }
+
+    // numeric integrations first, so that cheap chunks fill the gaps at the end
+    size_t nmid = 0;
+    for ( size_t ij=0; ij<ntot; ++ij )
+        if ( is_mid( w, n, nlim, lim_low, lim_hig, ij ) )
+            ++nmid;
+    size_t imid = 0, iser = nmid;
+    for ( size_t ij=0; ij<ntot; ++ij ) {
+        if ( is_mid( w, n, nlim, lim_low, lim_hig, ij ) )
+            order[imid++] = ij;
+        else
+            order[iser++] = ij;
+    }
+
+    // chunks of about equal predicted cost
+    const double cost = (double)nmid*COST_MID + (double)(ntot-nmid)*COST_SERIES;
+    const double target = cost / ( nthreads*CHUNKS_PER_THREAD );
+    size_t len_mid = (size_t)( target/COST_MID );
+    size_t len_ser = (size_t)( target/COST_SERIES );
+    if ( len_mid<1 )
+        len_mid = 1;
+    if ( len_ser<COST_MID )
+        len_ser = COST_MID;
+    const size_t nch_mid = ( nmid+len_mid-1 ) / len_mid;
+    const size_t nch_ser = ( ntot-nmid+len_ser-1 ) / len_ser;
+    const long nchunks = (long)( nch_mid+nch_ser );
+
+    // dynamic scheduling: idle threads take the next chunk from the queue
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1) reduction(+:nfail) \
+    if( cost>=2*COST_MID )
+#endif
+    for ( long c=0; c<nchunks; ++c ) {
+        size_t lo, hi;
+        if ( (size_t)c<nch_mid ) {
+            lo = c*len_mid;
+            hi = lo+len_mid<nmid ? lo+len_mid : nmid;
+        } else {
+            lo = nmid + ( c-nch_mid )*len_ser;
+            hi = lo+len_ser<ntot ? lo+len_ser : ntot;
+        }
+        for ( size_t k=lo; k<hi; ++k )
+            if ( eval( ctx, order[k]/n, order[k]%n ) )
+                ++nfail;
+    }
+    free( order );
+    return nfail;
+}
+
+
+/* Points per call of kww_series_block */
+#define SERIES_BLOCK 64
+
+void kww_batch_series( const int kind, const double* w, const size_t n,
+                       const double beta,
+                       const double lim_low, const double lim_hig,
+                       const kww_series_coef* coef, const double delta,
+                       double* out, char* done )
+{
+    size_t* idx;
+    size_t ns[2] = { 0, 0 }; // number of points for low-w, high-w series
+    // trivial cases are left to kww_at
+    if ( kind==0 && beta==2 )
+        return;
+    if ( !( idx = malloc( n*sizeof(size_t) ) ) )
+        return;
+    // all points are classified before any output is written, since out
+    // may be the same array as w; low-w from the start of idx, high-w from
+    // the end
+    for ( size_t i=0; i<n; ++i ) {
+        const double wa = fabs( w[i] );
+        if ( wa<lim_low && wa>0 )
+            idx[ns[0]++] = i;
+        else if ( wa>lim_hig )
+            idx[n-++ns[1]] = i;
+    }
+    for ( int hig=0; hig<2; ++hig ) {
+        const size_t m = ns[hig];
+        const size_t* ih = hig ? idx+n-m : idx;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if( m>=4*SERIES_BLOCK )
+#endif
+        for ( long b=0; b<(long)( ( m+SERIES_BLOCK-1 )/SERIES_BLOCK ); ++b ) {
+            const size_t lo = b*SERIES_BLOCK;
+            const size_t len = m-lo<SERIES_BLOCK ? m-lo : SERIES_BLOCK;
+            double wb[SERIES_BLOCK];
+            Xdouble s[SERIES_BLOCK];
+            for ( size_t l=0; l<len; ++l )
+                wb[l] = fabs( w[ih[lo+l]] );
+            kww_series_block( hig, kind==1, kind==2, wb, len, beta, coef,
+                              delta, s );
+            for ( size_t l=0; l<len; ++l ) {
+                const size_t i = ih[lo+l];
+                if ( !( s[l]>0 ) )
+                    continue; // numeric integration needed
+                out[i] = kind>0 && w[i]<0 ? -s[l] : s[l];
+                done[i] = 1;
+            }
+        }
+    }
+    free( idx );
+}
+
+/* Points per call of kww_mid_block */
+#define MID_BATCH 64
+
+void kww_batch_mid( const int kind, const double* w, const size_t n,
+                    const double beta, const double delta,
+                    double* out, char* done )
+{
+    size_t* idx;
+    size_t m = 0;
+    // trivial cases are left to kww_at
+    if ( kind==0 && beta==2 )
+        return;
+    if ( !( idx = malloc( n*sizeof(size_t) ) ) )
+        return;
+    // w[i] is only read where out[i] has not been written, as out may be
+    // the same array as w
+    for ( size_t i=0; i<n; ++i )
+        if ( !done[i] && w[i]!=0 && isfinite( w[i] ) )
+            idx[m++] = i;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if( m>=2*MID_BATCH )
+#endif
+    for ( long b=0; b<(long)( ( m+MID_BATCH-1 )/MID_BATCH ); ++b ) {
+        const size_t lo = b*MID_BATCH;
+        const size_t len = m-lo<MID_BATCH ? m-lo : MID_BATCH;
+        double wb[MID_BATCH];
+        Xdouble s[MID_BATCH];
+        for ( size_t l=0; l<len; ++l )
+            wb[l] = fabs( w[idx[lo+l]] );
+        kww_mid_block( kind>0, kind==2, wb, len, beta, delta, s );
+        for ( size_t l=0; l<len; ++l ) {
+            const size_t i = idx[lo+l];
+            if ( !( s[l]>0 ) )
+                continue; // left to kww_at, which reports the error
+            out[i] = kind>0 && w[i]<0 ? -s[l] : s[l];
+            done[i] = 1;
+        }
+    }
+    free( idx );
+}
+
+
+/*****************************************************************************/
+/*  Grid of frequencies times stretching exponents                           */
+/*****************************************************************************/
+
+/* Setup for one row of the grid */
+typedef struct {
+    double beta;
+    kww_plan* plan; // or NULL
+    const kww_series_coef* coef;
+} grid_row;
+
+typedef struct {
+    int kind;
+    const double* w;
+    size_t nw;
+    const grid_row* rows;
+    const double* lim_low;
+    const double* lim_hig;
+    double* out;
+    const char* done;  // or NULL; points done in block passes
+} grid_job;
+
+static int grid_at( void* ctx, const size_t j, const size_t i )
+{
+    const grid_job* G = ctx;
+    double* res = &G->out[j*G->nw+i];
+    if ( G->done && G->done[j*G->nw+i] )
+        return KWW_SUCCESS;
+    if ( !kww_beta_ok( G->rows[j].beta ) ) {
+        *res = NAN;
+        return KWW_EDOM;
+    }
+    return kww_at( G->kind, res, G->w[i], G->rows[j].beta,
+                   G->lim_low[j], G->lim_hig[j], G->rows[j].coef,
+                   kww_delta );
+}
+
+size_t kww_grid( const int kind, const double* w, const size_t nw,
+                 const double* beta, const size_t nb, double* out )
+{
+    size_t nfail = nw*nb;
+    grid_job G;
+    grid_row* rows = calloc( nb, sizeof(grid_row) );
+    double* lims = calloc( 2*nb, sizeof(double) );
+    char* done = NULL;
+    if ( kind<KWW_C || kind>KWW_P || !rows || !lims ) {
+        for ( size_t i=0; i<nw*nb; ++i )
+            out[i] = NAN;
+        goto done;
+    }
+
+    // one setup per row; plans are not worth it for short rows
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if( nw>=KWW_PLAN_MIN_SIZE )
+#endif
+    for ( long j=0; j<(long)nb; ++j ) {
+        const double b = beta[j];
+        grid_row* R = &rows[j];
+        R->beta = b;
+        R->plan = NULL;
+        R->coef = NULL;
+        if ( !kww_beta_ok( b ) ) {
+            lims[j] = lims[nb+j] = NAN;
+            continue;
+        }
+        if ( nw>=KWW_PLAN_MIN_SIZE && ( R->plan = kww_plan_create( b ) ) )
+            R->coef = &R->plan->coef;
+        lims[j] = kind==0 ? kwwc_lim_low( b ) :
+            kind==1 ? kwws_lim_low( b ) : kwwp_lim_low( b );
+        lims[nb+j] = kind==0 ? kwwc_lim_hig( b ) :
+            kind==1 ? kwws_lim_hig( b ) : kwwp_lim_hig( b );
+    }
+
+    G.kind = kind;
+    G.w = w;
+    G.nw = nw;
+    G.rows = rows;
+    G.lim_low = lims;
+    G.lim_hig = lims+nb;
+    G.out = out;
+    G.done = NULL;
+    // series expansions block-wise in rows that have a plan
+    if ( nw>=KWW_PLAN_MIN_SIZE && ( done = calloc( nw*nb, 1 ) ) ) {
+        for ( size_t j=0; j<nb; ++j ) {
+            if ( !rows[j].coef )
+                continue;
+            kww_batch_series( kind, w, nw, beta[j], lims[j], lims[nb+j],
+                              rows[j].coef, kww_delta, out+j*nw, done+j*nw );
+            kww_batch_mid( kind, w, nw, beta[j], kww_delta, out+j*nw,
+                           done+j*nw );
+        }
+        G.done = done;
+    }
+    nfail = kww_batch_run( w, nw, nb, 1, G.lim_low, G.lim_hig, grid_at, &G );
+
+    for ( size_t j=0; j<nb; ++j )
+        kww_plan_destroy( rows[j].plan );
+done:
+    free( rows );
+    free( lims );
+    free( done );
+    return nfail;
+}
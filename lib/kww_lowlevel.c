@@ -33,11 +33,13 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <float.h>
-#include <errno.h>
+#include <stdatomic.h>
 #include "kww.h"
 #include "kww_lowlevel.h"
+#include "kww_plan.h"
 
 #ifdef __MINGW32__
 #define printf __mingw_printf
@@ -47,146 +49,572 @@
 #define PI_2         1.57079632679489661923L  /* pi/2 */
 #define SQR(x) ((x)*(x))
 
-// for external analysis:
-KWW_EXPORT int kww_algorithm;
-KWW_EXPORT int kww_num_of_terms;
+// for external analysis; thread-local, and set once before returning:
+KWW_EXPORT _Thread_local int kww_algorithm;
+KWW_EXPORT _Thread_local int kww_num_of_terms;
 KWW_EXPORT int kww_debug=0;
 
 /*****************************************************************************/
 /*  Numeric precision and maximum number of terms                            */
 /*****************************************************************************/
 
-const double kww_delta=2.2e-16, kww_eps=5.5e-20;
-const int max_terms=200;
+const double kww_delta=KWW_TOL_MIN, kww_eps=5.5e-20;
+const int max_terms=KWW_MAX_TERMS;
+
+/*****************************************************************************/
+/*  Choice of vectorized kernels                                             */
+/*****************************************************************************/
+
+/* Instruction set used for the vectorized kernels; for diagnostics. */
+KWW_EXPORT const char* kww_isa = "generic";
+
+#ifdef KWW_SIMD
+static kww_mid_sum_simd_fn* mid_sum_simd = NULL;
+static kww_series_simd_fn* series_simd = NULL;
+
+// Chooses the vectorized kernels at load time, according to the CPU. For
+// testing, the choice can be restricted through the environment variable
+// KWW_ISA=avx2 or KWW_ISA=generic.
+__attribute__((constructor))
+static void simd_init( void )
+{
+    const char* env = getenv( "KWW_ISA" );
+    int max_isa = 2;
+    if ( env && !strcmp( env, "avx2" ) )
+        max_isa = 1;
+    else if ( env && !strcmp( env, "generic" ) )
+        max_isa = 0;
+    __builtin_cpu_init();
+    if ( max_isa>=2 && __builtin_cpu_supports( "avx512f" ) ) {
+        mid_sum_simd = kww_mid_sum_avx512;
+        series_simd = kww_series_avx512;
+        kww_isa = "avx512";
+    } else if ( max_isa>=1 && __builtin_cpu_supports( "avx2" ) &&
+                __builtin_cpu_supports( "fma" ) ) {
+        mid_sum_simd = kww_mid_sum_avx2;
+        series_simd = kww_series_avx2;
+        kww_isa = "avx2";
+    }
+}
+
+// Splits x into the double-double number hi+lo
+static void split_dd( double* hi, double* lo, const Xdouble x )
+{
+    *hi = (double)x;
+    *lo = (double)( x-*hi );
+}
+
+// Whether a series at frequency w can be summed by the vectorized kernel,
+// unless we want to see every term
+static int series_simd_ok( const double w )
+{
+    return series_simd && !kww_debug && w>=DBL_MIN && w<=DBL_MAX;
+}
+
+// Sets up lanes for frequencies w[0..m-1]. Lanes that cannot be handled
+// by the kernel are marked for evaluation in extended precision.
+static void series_lanes_init( kww_series_lanes* L, const double* w,
+                               const int m )
+{
+    L->i = 0;
+    for ( int l=0; l<KWW_SERIES_LANES; ++l ) {
+        L->w[l] = l<m ? w[l] : 1;
+        L->res[l] = l>=m ? 0 : series_simd_ok( w[l] ) ? NAN : KWW_SIMD_REDO;
+        L->res_lo[l] = 0;
+        L->nterms[l] = 0;
+    }
+}
+
+// Result of lane l, in extended precision
+static Xdouble series_res( const kww_series_lanes* L, const int l )
+{
+    return (Xdouble)L->res[l] + L->res_lo[l];
+}
+
+// Number of terms for which coefficients are computed at once, if not
+// taken from a plan
+#define SERIES_CHUNK 2
+
+/* Runs series jobs J[0..nj-1], all low-w or all high-w, on lanes L[j]
+   until they are finished. Coefficients are taken from coef, or else
+   computed when first needed, with the same expressions as in
+   kww_series_coef_init, so that results are identical. */
+static void series_simd_run( kww_series_job* J, kww_series_lanes* L,
+                             const int nj, const kww_series_coef* coef )
+{
+    const int hig = J[0].hig;
+    const double beta = J[0].beta;
+    int running[2] = { 1, nj>1 };
+
+    if ( coef ) {
+        for ( int j=0; j<nj; ++j ) {
+            if ( hig ) {
+                J[j].gl = coef->hig_gl_d;
+                J[j].ratio[0] = coef->hig_ratio_dd[0];
+                J[j].ratio[1] = coef->hig_ratio_dd[1];
+                J[j].trig[0] = coef->hig_trig_dd[J[j].kappa][0];
+                J[j].trig[1] = coef->hig_trig_dd[J[j].kappa][1];
+            } else {
+                J[j].gl = coef->low_gl_d;
+                J[j].ratio[0] = coef->low_ratio_dd[0];
+                J[j].ratio[1] = coef->low_ratio_dd[1];
+            }
+            running[j] = series_simd( &J[j], &L[j], max_terms );
+        }
+    } else {
+        Xdouble glx[2*KWW_MAX_TERMS];
+        double gl[2*KWW_MAX_TERMS];
+        double ratio[2][2*KWW_MAX_TERMS];
+        double trig[2][2][KWW_MAX_TERMS];
+        const Xdouble b = beta<1 ? beta : 2.0-beta; // as in hig_constants
+        const int step = hig ? 1 : 2; // index distance of successive terms
+        int ngl = 0;
+        int ntrig = 0;
+        int need[2] = { 0, 0 };
+        for ( int j=0; j<nj; ++j ) {
+            need[J[j].kappa] = 1;
+            J[j].gl = gl;
+            J[j].ratio[0] = ratio[0];
+            J[j].ratio[1] = ratio[1];
+            J[j].trig[0] = trig[J[j].kappa][0];
+            J[j].trig[1] = trig[J[j].kappa][1];
+        }
+        for ( int i=0; i<max_terms && ( running[0] || running[1] );
+              i+=SERIES_CHUNK ) {
+            const int i_end = i+SERIES_CHUNK<max_terms ? i+SERIES_CHUNK :
+                max_terms;
+            // coefficients up to index k=i_end, or kk=2*i_end-1
+            for ( ; ngl<( hig ? i_end+1 : 2*i_end ); ++ngl ) {
+                if ( !hig && !need[ngl & 1] )
+                    continue;
+                glx[ngl] = hig ?
+                    lgammaX(ngl*(Xdouble)beta+1)-lgammaX((Xdouble)ngl+1) :
+                    lgammaX((Xdouble)(ngl+1)/(Xdouble)beta)
+                    - lgammaX((Xdouble)ngl+1);
+                gl[ngl] = glx[ngl];
+                split_dd( &ratio[0][ngl], &ratio[1][ngl],
+                          expX( ngl<step ? glx[ngl] :
+                                glx[ngl]-glx[ngl-step] ) );
+            }
+            for ( ; hig && ntrig<i_end; ++ntrig ) {
+                for ( int kappa=0; kappa<2; ++kappa ) {
+                    Xdouble x;
+                    if ( !need[kappa] )
+                        continue;
+                    x = kappa ? cosX(PI_2*ntrig*b) : sinX(PI_2*ntrig*b);
+                    split_dd( &trig[kappa][0][ntrig], &trig[kappa][1][ntrig],
+                              x );
+                }
+            }
+            for ( int j=0; j<nj; ++j )
+                if ( running[j] )
+                    running[j] = series_simd( &J[j], &L[j], i_end );
+        }
+    }
+
+    // too many terms
+    for ( int j=0; j<nj; ++j ) {
+        for ( int l=0; l<KWW_SERIES_LANES; ++l ) {
+            if ( isnan( L[j].res[l] ) ) {
+                L[j].res[l] = -9;
+                L[j].nterms[l] = max_terms;
+            }
+        }
+    }
+}
+#endif
 
 /*****************************************************************************/
 /*  Low-level implementation: series expansion for low frequencies           */
 /*****************************************************************************/
 
+/* State of a low-w series that is summed term by term. */
+typedef struct {
+    int n;            // number of terms received
+    int isig;         // alternating sign
+    Xdouble S;        // summed series
+    Xdouble T;        // sum of absolute values
+    Xdouble u;        // last term received, not yet summed
+    double delta;     // relative tolerance
+} low_series;
+
+static void low_series_init( low_series* L, const double delta )
+{
+    L->n = 0;
+    L->delta = delta;
+    L->isig = 1;
+    L->S = 0;
+    L->T = 0;
+    L->u = 0;
+}
+
+// Computes term kk (this is 2*k+kappa) of the low-w series.
+// Returns 0, or a negative error code.
+static int low_term( Xdouble* u, const int kk, const int mu,
+                     const double beta, const Xdouble logw,
+                     const kww_series_coef* coef )
+{
+    Xdouble gl;
+    // use log gamma instead of gamma to avoid overflow
+    gl = ( coef ? coef->low_gl[kk] :
+           lgammaX((Xdouble)(kk+1)/(Xdouble)beta)-lgammaX((Xdouble)kk+1) )
+        + (kk+mu)*logw;
+    if ( gl>DBL_MAX_EXP/2 )
+        return -3; // gamma function overflow
+    *u = expX( gl );
+    if( mu )
+        *u /= (kk+1);
+    return 0;
+}
+
+// Receives the next term. Returns 1 if the series is finished, with
+// the result or a negative error code in *ret; else returns 0.
+static int low_series_add( low_series* L, const Xdouble u_next,
+                           const double beta, Xdouble* ret )
+{
+    // t_n must be computed in advance
+    const Xdouble u = L->u;
+    L->u = u_next;
+    if( !L->n++ )
+        return 0;
+    // now we use t_{n-1} to compute S_n
+    L->S += L->isig*u;
+    L->T += u;
+    // termination criteria
+    if ( kww_eps*L->T+u_next <= L->delta*L->S )
+        *ret = L->S / beta; // reached required precision
+    else if ( kww_eps*L->T >= L->delta*L->S )
+        *ret = -6; // too much cancellation
+    else if ( beta<1 && u_next>u )
+        *ret = -5; // asymptotic expansion diverges too early
+    else if ( L->S<DBL_MIN )
+        *ret = -7; // underflow
+    else {
+        L->isig = -L->isig;
+        return 0;
+    }
+    return 1;
+}
+
+#ifdef KWW_SIMD
+static void low_job_init( kww_series_job* J, const int kappa, const int mu,
+                          const double beta, const double delta )
+{
+    J->hig = 0;
+    J->kappa = kappa;
+    J->mu = mu;
+    J->alternating = 1;
+    J->beta = beta;
+    J->delta = delta;
+    J->truncfac = 1;
+    J->rfac = 1;
+}
+#endif
+
 Xdouble kww_low( const double w, const double beta,
-                const int kappa, const int mu )
+                 const int kappa, const int mu, const kww_series_coef* coef,
+                 const double delta )
 {
-    int kk;               // this is 2*k+kappa
-    int isig=1;           // alternating sign
-    Xdouble S=0;      // summed series
-    Xdouble T=0;      // sum of absolute values
-    Xdouble u;        // precomputed common factors
-    Xdouble u_next=0; // - next value [initialized to avoid warning]
-    Xdouble gl;       // local variable
+    int i;            // number of terms
+    int err;
+    low_series L;
+    Xdouble ret;      // return value
+    Xdouble u;        // next term
+    Xdouble logw;     // log(w)
 
-    // set diagnostic variable
+    // check input
+    if ( !( beta>=0.1 && beta<=2.0 && w>0 ) )
+        return KWW_EDOM;
+
+#ifdef KWW_SIMD
+    if ( series_simd_ok( w ) ) {
+        kww_series_job J;
+        kww_series_lanes V;
+        low_job_init( &J, kappa, mu, beta, delta );
+        series_lanes_init( &V, &w, 1 );
+        series_simd_run( &J, &V, 1, coef );
+        if ( V.res[0]!=KWW_SIMD_REDO ) {
+            kww_algorithm = 1;
+            kww_num_of_terms = V.nterms[0];
+            return series_res( &V, 0 );
+        }
+    }
+#endif
+
+    // sum the expansion
+    low_series_init( &L, delta );
+    logw = logX((Xdouble)w);
+    ret = -9; // too many terms, unless the loop is left earlier
+    for ( i=0; i<max_terms; ++i ) {
+        if ( ( err = low_term( &u, 2*i+kappa, mu, beta, logw, coef ) ) ) {
+            ret = err;
+            break;
+        }
+        if ( low_series_add( &L, u, beta, &ret ) )
+            break;
+    }
+
+    // set diagnostic variables
     kww_algorithm = 1;
+    kww_num_of_terms = i;
+    return ret;
+}
 
-    // check input
-    if ( beta<0.1 || beta>2.0 ) {
-        fprintf( stderr, "invalid call to kww_low: beta out of range\n" );
-        exit( EDOM );
+/* Cosine and sine transform at once. Their series interleave: the terms
+   with even kk belong to the cosine transform, odd kk to the sine. */
+void kww_low_cs( const double w, const double beta,
+                 const kww_series_coef* coef, const double delta,
+                 Xdouble* c, Xdouble* s )
+{
+    int kk;
+    int err;
+    int done[2] = { 0, 0 };
+    int nterms = 0;
+    low_series L[2];
+    Xdouble ret[2] = { -9, -9 }; // too many terms, unless finished earlier
+    Xdouble u;
+    Xdouble logw;
+
+    if ( !( beta>=0.1 && beta<=2.0 && w>0 ) ) {
+        *c = *s = KWW_EDOM;
+        return;
     }
-    if ( w<=0 ) {
-        fprintf( stderr, "invalid call to kww_low: w out of range\n" );
-        exit( EDOM );
+
+#ifdef KWW_SIMD
+    // the two series in parallel, sharing the coefficients
+    if ( series_simd_ok( w ) ) {
+        kww_series_job J[2];
+        kww_series_lanes V[2];
+        for ( int kappa=0; kappa<2; ++kappa ) {
+            low_job_init( &J[kappa], kappa, 0, beta, delta );
+            series_lanes_init( &V[kappa], &w, 1 );
+        }
+        series_simd_run( J, V, 2, coef );
+        Xdouble r[2];
+        for ( int kappa=0; kappa<2; ++kappa )
+            r[kappa] = V[kappa].res[0]==KWW_SIMD_REDO ?
+                kww_low( w, beta, kappa, 0, coef, delta ) :
+                series_res( &V[kappa], 0 );
+        kww_algorithm = 1;
+        kww_num_of_terms = V[0].nterms[0] + V[1].nterms[0];
+        *c = r[0];
+        *s = r[1];
+        return;
     }
+#endif
 
-    // sum the expansion
-    kk = kappa;
-    for ( int i=0; i<max_terms; ++i ) {
-        kww_num_of_terms = i;
-        // t_n must be computed in advance
-        u = u_next;
-        // use log gamma instead of gamma to avoid overflow
-        gl = lgammaX((Xdouble)(kk+1)/(Xdouble)beta)-
-            lgammaX((Xdouble)kk+1)+(kk+mu)*logX((Xdouble)w);
-        if ( gl>DBL_MAX_EXP/2 )
-            return -3; // gamma function overflow
-        u_next = expX( gl );
-        if( mu )
-            u_next /= (kk+1);
-        kk += 2;
-        if( !i )
+    low_series_init( &L[0], delta );
+    low_series_init( &L[1], delta );
+    logw = logX((Xdouble)w);
+    for ( kk=0; kk<2*max_terms && !( done[0] && done[1] ); ++kk ) {
+        const int kappa = kk & 1;
+        if ( done[kappa] )
             continue;
-        // now we use t_{n-1} to compute S_n
-        S += isig*u;
-        T += u;
-        // termination criteria
-        if ( kww_eps*T+u_next <= kww_delta*S )
-            return S / beta; // reached required precision
-        else if ( kww_eps*T >= kww_delta*S )
-            return -6; // too much cancellation
-        else if ( beta<1 && u_next>u )
-            return -5; // asymptotic expansion diverges too early
-        else if ( S<DBL_MIN )
-            return -7; // underflow
-        isig = -isig;
+        ++nterms;
+        if ( ( err = low_term( &u, kk, 0, beta, logw, coef ) ) ) {
+            ret[kappa] = err;
+            done[kappa] = 1;
+        } else
+            done[kappa] = low_series_add( &L[kappa], u, beta, &ret[kappa] );
     }
-    return -9; // too many terms
+
+    // set diagnostic variables
+    kww_algorithm = 1;
+    kww_num_of_terms = nterms;
+    *c = ret[0];
+    *s = ret[1];
 }
 
 Xdouble kwwc_low( const double w, const double beta )
 {
-    return kww_low( w, beta, 0, 0 );
+    return kww_low( w, beta, 0, 0, NULL, kww_delta );
 }
 
 Xdouble kwws_low( const double w, const double beta )
 {
-    return kww_low( w, beta, 1, 0 );
+    return kww_low( w, beta, 1, 0, NULL, kww_delta );
 }
 
 Xdouble kwwp_low( const double w, const double beta )
 {
-    return kww_low( w, beta, 0, 1 );
+    return kww_low( w, beta, 0, 1, NULL, kww_delta );
 }
 
 /*****************************************************************************/
 /*  Low-level implementation: series expansion for high frequencies          */
 /*****************************************************************************/
 
-Xdouble kww_hig( const double w, const double beta,
-                const int kappa, const int mu )
-{
-    int k;           // in computation of A_k w^k
-    int isig=1;      // alternating sign
-    int alternating; // has factor (-)^k
+/* Beta-dependent constants of the high-w series. */
+typedef struct {
+    int alternating;  // has factor (-)^k
     Xdouble b;        // either beta or 2-beta
     Xdouble sinphi;   // to compute r from u
     Xdouble truncfac; // for termination criterion
+} hig_constants;
+
+static void hig_constants_init( hig_constants* H, const double beta,
+                                const kww_series_coef* coef )
+{
+    if ( beta<1 ) {
+        H->b = beta;
+        H->alternating = 1;
+        H->sinphi = 1;
+        H->truncfac = 1;
+    } else {
+        H->b = 2.0-beta;
+        H->alternating = 0;
+        if ( coef ) {
+            H->sinphi = coef->sinphi;
+            H->truncfac = coef->truncfac;
+        } else {
+            H->sinphi = sinX( PI_2/(Xdouble)beta );
+            H->truncfac = powX( H->sinphi, -(Xdouble)beta );
+        }
+    }
+}
+
+#ifdef KWW_SIMD
+static void hig_job_init( kww_series_job* J, const int kappa, const int mu,
+                          const double beta, const hig_constants* C,
+                          const double delta )
+{
+    Xdouble rfac = 1/C->sinphi;  // as in hig_series_init
+    if( 1-kappa )
+        rfac *= C->truncfac;
+    J->hig = 1;
+    J->kappa = kappa;
+    J->mu = mu;
+    J->alternating = C->alternating;
+    J->beta = beta;
+    J->delta = delta;
+    J->truncfac = C->truncfac;
+    J->rfac = rfac;
+}
+#endif
+
+/* State of a high-w series that is summed term by term. */
+typedef struct {
+    int kappa;        // 0 for cosine, 1 for sine transform
+    int n;            // number of terms received
+    int isig;         // alternating sign
     Xdouble rfac;     // for computation of remainder
-    Xdouble S=0;      // summed series
-    Xdouble Sabs;     // absolute value thereof
-    Xdouble T=0;      // sum of absolute values
-    Xdouble u;        // precomputed common factors
-    Xdouble u_next=0; // - next value [initialized to avoid warning]
+    Xdouble S;        // summed series
+    Xdouble T;        // sum of absolute values
+    Xdouble u;        // last term received, not yet summed
+    double delta;     // relative tolerance
+} hig_series;
+
+static void hig_series_init( hig_series* H, const int kappa,
+                             const hig_constants* C, const double delta )
+{
+    H->kappa = kappa;
+    H->delta = delta;
+    H->n = 0;
+    H->isig = 1;
+    H->rfac = 1/C->sinphi;
+    if( 1-kappa )
+        H->rfac *= C->truncfac;
+    H->S = 0;
+    H->T = 0;
+    H->u = 0;
+}
+
+// Computes term k of the high-w series, without trigonometric factor.
+// Returns 0, or a negative error code.
+static int hig_term( Xdouble* u, const int k, const int mu,
+                     const double beta, const Xdouble logw,
+                     const kww_series_coef* coef )
+{
+    Xdouble x, gl;
+    x = k*(Xdouble)beta+1;
+    // use log gamma instead of gamma to avoid overflow
+    gl = ( coef ? coef->hig_gl[k] : lgammaX(x)-lgammaX((Xdouble)k+1) )
+        + (mu-x)*logw;
+    if ( gl>DBL_MAX_EXP/2 )
+        return -3; // gamma function overflow
+    *u = expX( gl );
+    if( mu )
+        *u /= k*(Xdouble)beta;
+    return 0;
+}
+
+// Receives term k. Returns 1 if the series is finished, with the result
+// or a negative error code in *ret; else returns 0.
+static int hig_series_add( hig_series* H, const Xdouble u_next, const int k,
+                           const double beta, const hig_constants* C,
+                           const kww_series_coef* coef, Xdouble* ret )
+{
     Xdouble s;        // full term (with trigonometric factor)
-    Xdouble x, gl;    // local variables
+    Xdouble Sabs;     // absolute value of S
+    // t_n must be computed in advance
+    const Xdouble u = H->u;
+    H->u = u_next;
+    if( !H->n++ )
+        return 0;
+    // now we use t_{n-1} to compute S_n
+    s = u * H->isig * ( coef ? coef->hig_trig[H->kappa][k-1] :
+                        H->kappa ? cosX(PI_2*(k-1)*C->b) :
+                        sinX(PI_2*(k-1)*C->b) );
+    H->S += s;
+    Sabs = fabsX(H->S);
+    H->T += fabsX(s);
+    H->rfac *= C->truncfac; // sin(phi)^(-1-k*beta)
+    if( kww_debug & 1 )
+        printf( "%3i %20.13Le %20.13Le %12.5Le %12.5Le %12.5Le %12.5Le"
+                " %12.5Le %12.5Le %12.5Le\n",
+                k+1, H->S, H->T, s, s/u, u, u_next, H->rfac,
+                kww_eps*H->T+u_next*H->rfac, H->delta*Sabs );
+    // termination criteria
+    if ( kww_eps*H->T+u_next*H->rfac <= H->delta*Sabs )
+        *ret = H->S; // reached required precision
+    else if ( beta>1 && u_next*C->truncfac>u )
+        *ret = -5; // asymptotic expansion diverges too early
+    else if ( Sabs<DBL_MIN )
+        *ret = -7; // underflow
+    else {
+        if ( C->alternating )
+            H->isig = -H->isig;
+        return 0;
+    }
+    return 1;
+}
 
-    // set diagnostic variable
-    kww_algorithm = 3;
+Xdouble kww_hig( const double w, const double beta,
+                 const int kappa, const int mu, const kww_series_coef* coef,
+                 const double delta )
+{
+    int i;            // number of terms
+    int err;
+    hig_constants C;
+    hig_series H;
+    Xdouble ret;      // return value
+    Xdouble u;        // next term
+    Xdouble logw;     // log(w)
 
     // check input
-    if ( beta<0.1 || beta>2.0 ) {
-        fprintf( stderr, "invalid call to kww_hig: beta out of range\n" );
-        exit( EDOM );
-    }
-    if ( w<=0 ) {
-        fprintf( stderr, "invalid call to kww_hig: w out of range\n" );
-        exit( EDOM );
-    }
+    if ( !( beta>=0.1 && beta<=2.0 && w>0 ) )
+        return KWW_EDOM;
 
     // set some beta-dependent constants
-    if ( beta<1 ) {
-        b = beta;
-        alternating = 1;
-        sinphi = 1;
-        truncfac = 1;
-    } else {
-        b = 2.0-beta;
-        alternating = 0;
-        sinphi = sinX( PI_2/(Xdouble)beta );
-        truncfac = powX( sinphi, -(Xdouble)beta );
+    hig_constants_init( &C, beta, coef );
+
+#ifdef KWW_SIMD
+    if ( series_simd_ok( w ) ) {
+        kww_series_job J;
+        kww_series_lanes V;
+        hig_job_init( &J, kappa, mu, beta, &C, delta );
+        series_lanes_init( &V, &w, 1 );
+        series_simd_run( &J, &V, 1, coef );
+        if ( V.res[0]!=KWW_SIMD_REDO ) {
+            kww_algorithm = 3;
+            kww_num_of_terms = V.nterms[0];
+            return series_res( &V, 0 );
+        }
     }
-    rfac = 1/sinphi;
+#endif
 
     if( kww_debug & 2 ) {
-        printf( "sinphi %20.14Le truncfac %20.14Le\n", sinphi, truncfac );
+        printf( "sinphi %20.14Le truncfac %20.14Le\n", C.sinphi, C.truncfac );
     }
     if( kww_debug & 1 )
         printf( "%3s %20s %20s %12s %12s %12s %12s %12s %12s %12s\n",
@@ -195,68 +623,224 @@ Xdouble kww_hig( const double w, const double beta,
                 "eps*T+u(k+1)*r", "delta*|S|" );
 
     // sum the expansion
-    k=1-kappa;
-    if( k )
-        rfac *= truncfac;
-    for ( int i=0; i<max_terms; ++i ) {
-        kww_num_of_terms = i;
-        // t_n must be computed in advance
-        u = u_next;
-        x = k*(Xdouble)beta+1;
-        // use log gamma instead of gamma to avoid overflow
-        gl = lgammaX(x)-lgammaX((Xdouble)k+1)+(mu-x)*logX((Xdouble)w);
-        if ( gl>DBL_MAX_EXP/2 )
-            return -3; // gamma function overflow
-        u_next = expX( gl );
-        if( mu )
-            u_next /= (k*beta);
-        ++k;
-        if( !i )
-            continue;
-        // now we use t_{n-1} to compute S_n (k is even 2 ahead)
-        s = u * isig * ( kappa ? cosX(PI_2*(k-2)*b) : sinX(PI_2*(k-2)*b) );
-        S += s;
-        Sabs = fabsX(S);
-        T += fabsX(s);
-        rfac *= truncfac; // sin(phi)^(-1-k*beta)
-        if( kww_debug & 1 )
-            printf( "%3i %20.13Le %20.13Le %12.5Le %12.5Le %12.5Le %12.5Le"
-                    " %12.5Le %12.5Le %12.5Le\n",
-                    k, S, T, s, s/u, u, u_next, rfac,
-                    kww_eps*T+u_next*rfac, kww_delta*Sabs );
-        // termination criteria
-        if ( kww_eps*T+u_next*rfac <= kww_delta*Sabs )
-            return S; // reached required precision
-        else if ( beta>1 && u_next*truncfac>u )
-            return -5; // asymptotic expansion diverges too early
-        else if ( Sabs<DBL_MIN )
-            return -7; // underflow
-        if ( alternating )
-            isig = -isig;
+    hig_series_init( &H, kappa, &C, delta );
+    logw = logX((Xdouble)w);
+    ret = -9; // not converged, unless the loop is left earlier
+    for ( i=0; i<max_terms; ++i ) {
+        const int k = 1-kappa+i;
+        if ( ( err = hig_term( &u, k, mu, beta, logw, coef ) ) ) {
+            ret = err;
+            break;
+        }
+        if ( hig_series_add( &H, u, k, beta, &C, coef, &ret ) )
+            break;
+    }
+
+    // set diagnostic variables
+    kww_algorithm = 3;
+    kww_num_of_terms = i;
+    return ret;
+}
+
+/* Cosine and sine transform at once. Both series consist of the same terms
+   u(k), multiplied by different trigonometric factors. The sine series
+   starts at k=0, the cosine series at k=1. */
+void kww_hig_cs( const double w, const double beta,
+                 const kww_series_coef* coef, const double delta,
+                 Xdouble* c, Xdouble* s )
+{
+    int k;
+    int err;
+    int done[2] = { 0, 0 };
+    hig_constants C;
+    hig_series H[2];
+    Xdouble ret[2] = { -9, -9 }; // not converged, unless finished earlier
+    Xdouble u;
+    Xdouble logw;
+
+    if ( !( beta>=0.1 && beta<=2.0 && w>0 ) ) {
+        *c = *s = KWW_EDOM;
+        return;
     }
-    return -9; // not converged
+
+    hig_constants_init( &C, beta, coef );
+
+#ifdef KWW_SIMD
+    // the two series in parallel, sharing the coefficients
+    if ( series_simd_ok( w ) ) {
+        kww_series_job J[2];
+        kww_series_lanes V[2];
+        for ( int kappa=0; kappa<2; ++kappa ) {
+            hig_job_init( &J[kappa], kappa, 0, beta, &C, delta );
+            series_lanes_init( &V[kappa], &w, 1 );
+        }
+        series_simd_run( J, V, 2, coef );
+        Xdouble r[2];
+        for ( int kappa=0; kappa<2; ++kappa )
+            r[kappa] = V[kappa].res[0]==KWW_SIMD_REDO ?
+                kww_hig( w, beta, kappa, 0, coef, delta ) :
+                series_res( &V[kappa], 0 );
+        kww_algorithm = 3;
+        kww_num_of_terms = V[0].nterms[0] + V[1].nterms[0];
+        *c = r[0];
+        *s = r[1];
+        return;
+    }
+#endif
+
+    hig_series_init( &H[0], 0, &C, delta );
+    hig_series_init( &H[1], 1, &C, delta );
+    logw = logX((Xdouble)w);
+    for ( k=0; k<=max_terms && !( done[0] && done[1] ); ++k ) {
+        const int need[2] = { k>0 && !done[0], k<max_terms && !done[1] };
+        err = hig_term( &u, k, 0, beta, logw, coef );
+        for ( int kappa=0; kappa<2; ++kappa ) {
+            if ( !need[kappa] )
+                continue;
+            if ( err ) {
+                ret[kappa] = err;
+                done[kappa] = 1;
+            } else
+                done[kappa] = hig_series_add( &H[kappa], u, k, beta, &C, coef,
+                                              &ret[kappa] );
+        }
+    }
+
+    // set diagnostic variables
+    kww_algorithm = 3;
+    kww_num_of_terms = k;
+    *c = ret[0];
+    *s = ret[1];
 }
 
 Xdouble kwwc_hig( const double w, const double beta )
 {
-    return kww_hig( w, beta, 0, 0 );
+    return kww_hig( w, beta, 0, 0, NULL, kww_delta );
 }
 
 Xdouble kwws_hig( const double w, const double beta )
 {
-    return kww_hig( w, beta, 1, 0 );
+    return kww_hig( w, beta, 1, 0, NULL, kww_delta );
 }
 
 Xdouble kwwp_hig( const double w, const double beta )
 {
-    double res = kww_hig( w, beta, 0, 1 );
-    if ( res>=PI_2 ) {
-        fprintf( stderr, "kwwp: invalid result %g <= 0\n", res );
-        exit( ENOSYS );
-    }
+    return kwwp_hig_coef( w, beta, NULL, kww_delta );
+}
+
+// Returns kwwp from the result res of the high-w series with mu=1.
+static Xdouble kwwp_hig_finish( const double w, const double beta,
+                                const kww_series_coef* coef,
+                                const double delta, Xdouble res )
+{
+    // relative error of the result is that of res, times res/(pi/2-res);
+    // if that matters, recompute res with tighter tolerance
+    if ( delta>kww_delta && res>PI_2-res && res<PI_2 )
+        res = kww_hig( w, beta, 0, 1, coef,
+                       fmax( kww_delta, delta*(PI_2-res)/res ) );
+    if ( res>=PI_2 )
+        return -8; // invalid result <= 0
     return res<0 ? res : PI_2-res;
 }
 
+Xdouble kwwp_hig_coef( const double w, const double beta,
+                       const kww_series_coef* coef, const double delta )
+{
+    return kwwp_hig_finish( w, beta, coef, delta,
+                            kww_hig( w, beta, 0, 1, coef, delta ) );
+}
+
+
+/*****************************************************************************/
+/*  Series expansions for a block of frequencies                             */
+/*****************************************************************************/
+
+void kww_series_block( const int hig, const int kappa, const int mu,
+                       const double* w, const size_t n, const double beta,
+                       const kww_series_coef* coef, const double delta,
+                       Xdouble* res )
+{
+#ifdef KWW_SIMD
+    // KWW_SERIES_LANES frequencies at a time, with common coefficients
+    if ( series_simd && !kww_debug && beta>=0.1 && beta<=2.0 ) {
+        kww_series_job J;
+        if ( hig ) {
+            hig_constants C;
+            hig_constants_init( &C, beta, coef );
+            hig_job_init( &J, kappa, mu, beta, &C, delta );
+        } else
+            low_job_init( &J, kappa, mu, beta, delta );
+        for ( size_t i0=0; i0<n; i0+=KWW_SERIES_LANES ) {
+            const int m = n-i0<KWW_SERIES_LANES ? (int)(n-i0) :
+                KWW_SERIES_LANES;
+            kww_series_lanes V;
+            series_lanes_init( &V, w+i0, m );
+            series_simd_run( &J, &V, 1, coef );
+            for ( int l=0; l<m; ++l ) {
+                const double wl = w[i0+l];
+                Xdouble r = series_res( &V, l );
+                if ( r==KWW_SIMD_REDO )
+                    r = hig ? kww_hig( wl, beta, kappa, mu, coef, delta ) :
+                        kww_low( wl, beta, kappa, mu, coef, delta );
+                if ( hig && mu )
+                    r = kwwp_hig_finish( wl, beta, coef, delta, r );
+                res[i0+l] = r;
+            }
+        }
+        return;
+    }
+#endif
+    for ( size_t i=0; i<n; ++i )
+        res[i] = !hig ? kww_low( w[i], beta, kappa, mu, coef, delta ) :
+            mu ? kwwp_hig_coef( w[i], beta, coef, delta ) :
+            kww_hig( w[i], beta, kappa, 0, coef, delta );
+}
+
+
+/*****************************************************************************/
+/*  Beta-dependent series coefficients, for use in a kww_plan               */
+/*****************************************************************************/
+
+void kww_series_coef_init( kww_series_coef* coef, const double beta )
+{
+    hig_constants C;
+
+    // same expressions as in kww_low and kww_hig, to get identical results
+    for ( int kk=0; kk<2*max_terms; ++kk )
+        coef->low_gl[kk] =
+            lgammaX((Xdouble)(kk+1)/(Xdouble)beta)-lgammaX((Xdouble)kk+1);
+    for ( int k=0; k<=max_terms; ++k )
+        coef->hig_gl[k] =
+            lgammaX(k*(Xdouble)beta+1)-lgammaX((Xdouble)k+1);
+    hig_constants_init( &C, beta, NULL );
+    coef->sinphi = C.sinphi;
+    coef->truncfac = C.truncfac;
+    for ( int k=0; k<max_terms; ++k ) {
+        coef->hig_trig[0][k] = sinX(PI_2*k*C.b);
+        coef->hig_trig[1][k] = cosX(PI_2*k*C.b);
+    }
+
+#ifdef KWW_SIMD
+    for ( int kk=0; kk<2*max_terms; ++kk )
+        coef->low_gl_d[kk] = coef->low_gl[kk];
+    for ( int kk=0; kk<2*max_terms; ++kk )
+        split_dd( &coef->low_ratio_dd[0][kk], &coef->low_ratio_dd[1][kk],
+                  expX( kk<2 ? coef->low_gl[kk] :
+                        coef->low_gl[kk]-coef->low_gl[kk-2] ) );
+    for ( int k=0; k<=max_terms; ++k )
+        coef->hig_gl_d[k] = coef->hig_gl[k];
+    for ( int k=0; k<=max_terms; ++k )
+        split_dd( &coef->hig_ratio_dd[0][k], &coef->hig_ratio_dd[1][k],
+                  expX( k<1 ? coef->hig_gl[k] :
+                        coef->hig_gl[k]-coef->hig_gl[k-1] ) );
+    for ( int kappa=0; kappa<2; ++kappa )
+        for ( int k=0; k<max_terms; ++k )
+            split_dd( &coef->hig_trig_dd[kappa][0][k],
+                      &coef->hig_trig_dd[kappa][1][k],
+                      coef->hig_trig[kappa][k] );
+#endif
+}
+
 
 /*****************************************************************************/
 /*  Low-level implementation: integration for intermediate frequencies       */
@@ -264,193 +848,912 @@ Xdouble kwwp_hig( const double w, const double beta )
 
 #define max_iter_int 12
 #define num_range 6
-Xdouble kww_mid( const double w, const double beta,
-                const int kind, const int mu )
-// kind: 0 cos, 1 sin transform (precomputing arrays[2] depend on this)
+
+/* Nodes ak, their logarithms, and weights bk of the trapezoid sum in
+   iteration iter, for given kind and beta range. They are computed when
+   first needed, and then published to all threads through an atomic
+   pointer, unless they have been generated at build time. */
+typedef struct {
+    int N;               // sum runs over 2*N+1 nodes
+    const Xdouble* ak;
+    const Xdouble* lak;  // log(ak), so that tk^beta = exp(beta*(lak-log(w)))
+    const Xdouble* bk;
+#ifdef KWW_SIMD
+    const double* split; // ak, bk, lak as hi+lo doubles, for vectorized sum
+#endif
+} kww_mid_table;
+
+/* Transformation parameters p, q for beta ranges j, which start at
+   mid_beta[j-1] */
+static const double mid_beta[num_range-1] = { 0.15, 0.25, 1, 1.75, 1.95 };
+static const double mid_p[num_range] = { 1.8, 1.6, 1.4, 1.0, .75, .15 };
+static const double mid_q[num_range] = { 0.2, 0.4, 0.6, 0.2, 0.2, 0.4 };
+
+// Returns the beta range j, and sets the transformation parameters p,q
+static int mid_range( const double beta, double* p, double* q )
+{
+    int j = 0;
+    while ( j<num_range-1 && beta>=mid_beta[j] )
+        ++j;
+    *p = mid_p[j];
+    *q = mid_q[j];
+    return j;
+}
+
+#ifdef KWW_MID_TABLES
+// tables for iter<KWW_MID_TABLE_ITER, generated by kww_mktables
+#include "kww_mid_tables.h"
+#endif
+
+static _Atomic(kww_mid_table*) mid_tables[2][num_range][max_iter_int];
+
+static void mid_table_free( kww_mid_table* tab )
+{
+    free( (Xdouble*)tab->ak );
+    free( (Xdouble*)tab->lak );
+    free( (Xdouble*)tab->bk );
+#ifdef KWW_SIMD
+    free( (double*)tab->split );
+#endif
+    free( tab );
+}
+
+// Allocates and fills a table for given kind, N, and transformation
+// parameters p, q. Returns 0 on success, or a negative error code.
+static int mid_table_new( kww_mid_table** ret, const int kind, const int N,
+                          const double p, const double q )
 {
-    int iter;
     int kaux;
     int isig;
-    int N;
-    int j;               // range
-    int diffmode;        // subtract Gaussian ?
-    Xdouble S=0;     // trapezoid sum
-    Xdouble S_last;  // - in last iteration
-    Xdouble s;       // term contributing to S
-    Xdouble T;       // sum of abs(s)
-    // precomputed coefficients
-    static int firstCall=1;
-    static int iterDone[2][num_range]; // Nm,Np,ak,bk are precomputed up to this
-    static int NN[num_range][max_iter_int];
-    static Xdouble *ak[2][num_range][max_iter_int];
-    static Xdouble *bk[2][num_range][max_iter_int];
-    // auxiliary for computing ak and bk
+    kww_mid_table* tab;
     Xdouble u;
     Xdouble e;
-    Xdouble tk;
     Xdouble chi;
     Xdouble dchi;
     Xdouble h;
     Xdouble k;
-    Xdouble f;
     Xdouble ahk;
     Xdouble chk;
     Xdouble dhk;
+    Xdouble* ak;
+    Xdouble* lak;
+    Xdouble* bk;
+#ifdef KWW_SIMD
+    double* split;
+#endif
+    const double Smin=2e-20; // to assess worst truncation error
+
+    if ( N>1e6 )
+        return -3; // integral limits overflow
+    if ( !( tab=malloc(sizeof(kww_mid_table)) ) )
+        return KWW_ENOMEM;
+    tab->N = N;
+    tab->ak = ak = malloc((sizeof(Xdouble))*(2*N+1));
+    tab->lak = lak = malloc((sizeof(Xdouble))*(2*N+1));
+    tab->bk = bk = malloc((sizeof(Xdouble))*(2*N+1));
+#ifdef KWW_SIMD
+    tab->split = split =
+        mid_sum_simd ? malloc((sizeof(double))*6*(2*N+1)) : NULL;
+    if ( mid_sum_simd && !split ) {
+        mid_table_free( tab );
+        return KWW_ENOMEM;
+    }
+#endif
+    if ( !ak || !lak || !bk ) {
+        mid_table_free( tab );
+        return KWW_ENOMEM;
+    }
+    h = logX( logX( 42*N/kww_delta/Smin ) / p ) / N; // 42=(pi+1)*10
+    isig=1-2*(N&1);
+    for ( kaux=-N; kaux<=N; ++kaux ) {
+        k = kaux;
+        if( !kind )
+            k -= 0.5;
+        u = k*h;
+        chi  = 2*p*sinhX(u) + 2*q*u;
+        dchi = 2*p*coshX(u) + 2*q;
+        if ( u==0 ) {
+            if ( k!=0 ) {
+                mid_table_free( tab );
+                return -4; // integration variable underflow
+            }
+            // special treatment to bridge singularity at u=0
+            ahk = PI/h/dchi;
+            dhk = 0.5;
+            chk = sin( ahk );
+        } else {
+            if ( -chi>DBL_MAX_EXP/2 ) {
+                mid_table_free( tab );
+                return -5; // integral transformation overflow
+            }
+            e = expX( -chi );
+            ahk = PI/h * u/(1-e);
+            dhk = 1/(1-e) - u*e*dchi/SQR(1-e);
+            chk = e>1 ?
+                ( kind ? sinX( PI*k/(1-e) ) : cosX( PI*k/(1-e) ) ) :
+                isig * sinX( PI*k*e/(1-e) );
+        }
+        ak[kaux+N] = ahk;
+        lak[kaux+N] = logX( ahk );
+        bk[kaux+N] = dhk * chk;
+        isig = -isig;
+    }
+#ifdef KWW_SIMD
+    for ( int i=0; split && i<2*N+1; ++i ) {
+        const int n = 2*N+1;
+        split_dd( &split[i], &split[n+i], ak[i] );
+        split_dd( &split[2*n+i], &split[3*n+i], bk[i] );
+        split_dd( &split[4*n+i], &split[5*n+i], lak[i] );
+    }
+#endif
+    *ret = tab;
+    return 0;
+}
+
+// Returns the shared table for given kind, range j and iteration, creating
+// it if needed. Lock-free: if several threads race to create the same table,
+// one of them wins, and the others discard their copy.
+static int mid_table_get( const kww_mid_table** ret, const int kind,
+                          const int j, const int iter,
+                          const double p, const double q )
+{
+    kww_mid_table* tab;
+    kww_mid_table* expected = NULL;
+    int err;
+
+#ifdef KWW_MID_TABLES
+    if ( iter<KWW_MID_TABLE_ITER ) {
+        *ret = &mid_tables_pre[kind][j][iter];
+        return 0;
+    }
+#endif
+    tab = atomic_load_explicit( &mid_tables[kind][j][iter],
+                                memory_order_acquire );
+    if ( !tab ) {
+        if( kww_debug & 8 ) {
+            printf( "init iter %i kind %i j %i siz %i\n",
+                    iter, kind, j, 2*(40<<iter)+1 );
+        }
+        if ( ( err = mid_table_new( &tab, kind, 40<<iter, p, q ) ) )
+            return err;
+        if ( !atomic_compare_exchange_strong_explicit(
+                 &mid_tables[kind][j][iter], &expected, tab,
+                 memory_order_acq_rel, memory_order_acquire ) ) {
+            mid_table_free( tab );
+            tab = expected;
+        }
+    }
+    *ret = tab;
+    return 0;
+}
+
+int kww_mid_tables_init( const double beta_min, const double beta_max,
+                         const int niter )
+{
     double p;
     double q;
-    const double Smin=2e-20; // to assess worst truncation error
+    const int j0 = mid_range( beta_min, &p, &q );
+    const int j1 = mid_range( beta_max, &p, &q );
+    int err;
 
-    // dynamic initialization upon first call
-    if ( firstCall ) {
-        for ( j=0; j<num_range; ++ j ) {
-            iterDone[0][j] = -1;
-            iterDone[1][j] = -1;
+    if ( niter<1 || niter>max_iter_int )
+        return KWW_EDOM;
+    for ( int kind=0; kind<2; ++kind ) {
+        for ( int j=j0; j<=j1; ++j ) {
+            for ( int iter=0; iter<niter; ++iter ) {
+                const kww_mid_table* tab;
+                if ( ( err = mid_table_get( &tab, kind, j, iter,
+                                            mid_p[j], mid_q[j] ) ) )
+                    return err;
+            }
         }
-        firstCall = 0;
     }
+    return 0;
+}
 
-    // check input
-    if ( !( kind==0 || kind==1 ) ) {
-        fprintf( stderr, "invalid call to kww_mid: invalid kind\n" );
-        exit( EDOM );
-    } else if ( beta<0.1 || beta>2.0 ) {
-        fprintf( stderr, "invalid call to kww_mid: beta out of range\n" );
-        exit( EDOM );
-    } else if ( w<=0 ) {
-        fprintf( stderr, "invalid call to kww_mid: w out of range\n" );
-        exit( EDOM );
+void kww_mid_tables_free( void )
+{
+    for ( int kind=0; kind<2; ++kind ) {
+        for ( int j=0; j<num_range; ++j ) {
+            for ( int iter=0; iter<max_iter_int; ++iter ) {
+                kww_mid_table* tab = atomic_exchange_explicit(
+                    &mid_tables[kind][j][iter], NULL, memory_order_acq_rel );
+                if ( tab )
+                    mid_table_free( tab );
+            }
+        }
     }
+}
 
+/* One trapezoid sum, computed along with others over the same range j. */
+typedef struct {
+    int kind;         // 0 cos, 1 sin transform
+    int mu;           // 1 for primitive
+    int deriv;        // 0, or KWW_MID_DW, KWW_MID_DB for a derivative
+    int diffmode;     // subtract Gaussian ?
+    int done;
+    int ok;           // ret holds a result, which may be negative for deriv
+    double delta;     // relative tolerance
+    const Xdouble* ref; // or NULL: sum whose magnitude is added to |S|
+                        //   in the termination criteria
+    Xdouble S;        // trapezoid sum
+    Xdouble S_last;   // - in last iteration
+    Xdouble T;        // sum of abs(s)
+    Xdouble ret;      // result, or negative error code
+} mid_channel;
+
+static void mid_channel_init( mid_channel* ch, const int kind, const int mu,
+                              const double beta, const double delta )
+{
+    ch->kind = kind;
+    ch->delta = delta;
+    ch->mu = mu;
+    ch->deriv = 0;
     // cosine transform needs special care for beta->2
-    if ( kind==0 ) {
-        if ( beta==2 )
-            return sqrt(PI)/2*exp(-SQR(w)/4);
-        diffmode = beta>1.75;
-    } else {
-        diffmode = 0;
-    }
-
-    // determine range, set p,q
-    if        ( beta<0.15 ) {
-        j=0; p=1.8; q=0.2;
-    } else if ( beta<0.25 ) {
-        j=1; p=1.6; q=0.4;
-    } else if ( beta<1 ) {
-        j=2; p=1.4; q=0.6;
-    } else if ( beta<1.75 ) {
-        j=3; p=1.0; q=0.2;
-    } else if ( beta<1.95 ) {
-        j=4; p=.75; q=0.2;
-    } else {
-        j=5; p=.15; q=0.4;
+    ch->diffmode = kind==0 && beta>1.75;
+    ch->done = 0;
+    ch->ok = 0;
+    ch->ref = NULL;
+    ch->S = 0;
+    ch->ret = -9; // not converged, unless finished earlier
+}
+
+#define max_channels 3
+
+// Adds nodes lo..hi-1 of the trapezoid sum to ch[c]->S and ch[c]->T for
+// nch channels of the same kind. The integrand exp(-tk^beta), which
+// dominates the cost, is computed only once per node for all of them.
+static void mid_sum( mid_channel* const* ch, const int nch,
+                     const kww_mid_table* tab, const int lo, const int hi,
+                     const double w, const double beta, const int iter )
+{
+#ifdef KWW_SIMD
+    // vectorized, if supported, unless we want to see every term
+    if ( mid_sum_simd && !kww_debug ) {
+        const int n = 2*tab->N+1;
+        const kww_mid_split split = { tab->split, tab->split+n,
+                                      tab->split+2*n, tab->split+3*n,
+                                      tab->split+4*n, tab->split+5*n };
+        int mu[max_channels] = { 0 };
+        int deriv[max_channels] = { 0 };
+        int diffmode[max_channels] = { 0 };
+        double S[2*max_channels];
+        double T[2*max_channels];
+        for ( int c=0; c<nch; ++c ) {
+            mu[c] = ch[c]->mu;
+            deriv[c] = ch[c]->deriv;
+            diffmode[c] = ch[c]->diffmode;
+        }
+        mid_sum_simd( &split, lo, hi, w, beta, nch, mu, deriv, diffmode,
+                      S, T );
+        for ( int c=0; c<nch; ++c ) {
+            ch[c]->S += (Xdouble)S[2*c] + S[2*c+1];
+            ch[c]->T += (Xdouble)T[2*c] + T[2*c+1];
+        }
+        return;
     }
+#endif
 
-    // iterative integration
+    Xdouble tk;
+    Xdouble ltk;     // log(tk)
+    Xdouble x;       // tk^beta
+    Xdouble f0;
+    Xdouble f;
+    Xdouble s;       // term contributing to S
+    Xdouble S[max_channels];
+    Xdouble T[max_channels];
+    const Xdouble logw = logX( (Xdouble)w );
+    for ( int c=0; c<nch; ++c ) {
+        S[c] = ch[c]->S;
+        T[c] = ch[c]->T;
+    }
+    for ( int i=lo; i<hi; ++i ) {
+        tk = tab->ak[i] / w;
+        ltk = tab->lak[i]-logw;
+        x = expX(beta*ltk);
+        f0 = expX(-x);
+        for ( int c=0; c<nch; ++c ) {
+            f = f0;
+            if ( ch[c]->deriv==KWW_MID_DW )
+                f *= beta*x-1;
+            else if ( ch[c]->deriv==KWW_MID_DB )
+                f *= -x*ltk;
+            if ( ch[c]->diffmode )
+                // Gaussian, or its counterpart for KWW_MID_DW at beta=2
+                f -= ( ch[c]->deriv ? 2*SQR(tk)-1 : 1 ) * expX(-SQR(tk));
+            if ( ch[c]->mu )
+                f /= tk;
+            s = tab->bk[i] * f;
+            S[c] += s;
+            T[c] += fabsX(s);
+            if( kww_debug & 2 )
+                printf( "%2i %6i %12.4Lg %12.4Lg"
+                        " %12.4Lg %12.4Lg %12.4Lg %12.4Lg\n",
+                        iter, i-tab->N, tab->ak[i], tab->bk[i],
+                        f, s, S[c], T[c] );
+        }
+    }
+    for ( int c=0; c<nch; ++c ) {
+        ch[c]->S = S[c];
+        ch[c]->T = T[c];
+    }
+}
+
+// Nodes are processed in blocks, so that the tables of all channels are
+// streamed through the cache together.
+#define MID_BLOCK 512
+
+// Integrand exp(-tk^beta) below exp(-MID_TAIL) is negligible: even summed
+// over all nodes, with |bk|<2, it stays far below kww_eps times any sum.
+#define MID_TAIL 100
+
+// Returns the number of nodes to be summed. As the ak increase with k,
+// and the integrand decreases with tk=ak/w, the sum can stop at the first
+// node with tk^beta > MID_TAIL. For low w, this skips most of the right
+// tail, which the table provides for high w.
+static int mid_tail( const kww_mid_table* tab, const double w,
+                     const double beta )
+{
+    const Xdouble akmax = w * powX( (Xdouble)MID_TAIL, 1/(Xdouble)beta );
+    int lo = 0;
+    int hi = 2*tab->N+1;
+    // bisection for the first node with ak > akmax
+    while ( lo<hi ) {
+        const int mid = lo + (hi-lo)/2;
+        if ( tab->ak[mid]>akmax )
+            hi = mid;
+        else
+            lo = mid+1;
+    }
+    return lo;
+}
+
+// Completes the sum of channel C in iteration iter, and applies the
+// termination criteria. Returns 1 if C is finished, with the result or a
+// negative error code in C->ret; else returns 0.
+static int mid_channel_check( mid_channel* C, const double w, const int iter )
+{
+    Xdouble scale;
+    if( kww_debug & 1 )
+        printf( "%23.17Le  %23.17Le\n", C->S, C->T );
+    if ( C->diffmode )
+        // transform of the Gaussian, or of its counterpart for KWW_MID_DW
+        C->S += ( C->deriv ? -SQR(w)/2 : 1 ) * w/sqrt(PI)/2*exp(-SQR(w)/4);
+    scale = fabsX(C->S) + ( C->ref ? fabsX(*C->ref) : 0 );
+    // termination criteria
+    if      ( kww_debug & 4 )
+        C->ret = -1; // we want to inspect just one sum
+    else if ( C->S < 0 && !C->diffmode && !C->deriv )
+        C->ret = -6; // cancelling terms lead to negative S
+    else if ( kww_eps*C->T > C->delta*scale )
+        C->ret = -2; // cancellation
+    else if ( iter &&
+              fabsX(C->S-C->S_last) + kww_eps*C->T < C->delta*scale ) {
+        // success (for factor pi/w see my eq. 48)
+        C->ret = C->S * PI / w;
+        C->ok = 1;
+    } else
+        return 0;
+    C->done = 1;
+    return 1;
+}
+
+/* Iterative integration of nch<=max_channels trapezoid sums,
+   for the same w and beta. */
+static void kww_mid_channels( const double w, const double beta,
+                              mid_channel* ch, const int nch )
+{
+    int iter;
+    int err;
+    int nterms=0;        // total number of terms, for diagnostics
+    int ndone=0;
+    const kww_mid_table* tab[2];
+    int nk[2];           // number of nodes to be summed, per table
+    kww_mid_table* own[2] = { NULL, NULL }; // unshared tables, for debugging
+    double p;
+    double q;
+    const int j = mid_range( beta, &p, &q );
+
+    for ( iter=0; iter<max_iter_int && ndone<nch; ++iter ) {
+        // get the tables needed by unfinished channels
+        tab[0] = tab[1] = NULL;
+        for ( int c=0; c<nch; ++c ) {
+            const int kind = ch[c].kind;
+            if ( ch[c].done || tab[kind] )
+                continue;
+            if( kww_debug & 4 ) {
+                // do not iterate, inspect just one sum, with uncached table
+                err = mid_table_new( &own[kind], kind, 100, p, q );
+                tab[kind] = own[kind];
+            } else
+                err = mid_table_get( &tab[kind], kind, j, iter, p, q );
+            if ( err ) {
+                for ( int d=c; d<nch; ++d ) {
+                    if ( !ch[d].done && ch[d].kind==kind ) {
+                        ch[d].ret = err;
+                        ch[d].done = 1;
+                        ++ndone;
+                    }
+                }
+            }
+        }
+        if ( ndone==nch )
+            break;
+        for ( int kind=0; kind<2; ++kind )
+            nk[kind] = !tab[kind] ? 0 : kww_debug & 4 ? 2*tab[kind]->N+1 :
+                mid_tail( tab[kind], w, beta );
+
+        // integrate according to trapezoidal rule; finished channels
+        // keep their sum, which may be the ref of others
+        for ( int c=0; c<nch; ++c ) {
+            if ( ch[c].done )
+                continue;
+            ch[c].S_last = ch[c].S;
+            ch[c].S = 0;
+            ch[c].T = 0;
+        }
+        for ( int lo=0; lo<nk[0] || lo<nk[1]; lo+=MID_BLOCK ) {
+            for ( int kind=0; kind<2; ++kind ) {
+                const int hi = lo+MID_BLOCK < nk[kind] ? lo+MID_BLOCK :
+                    nk[kind];
+                // unfinished channels that use this table
+                mid_channel* chk[max_channels];
+                int nchk = 0;
+                for ( int c=0; c<nch; ++c )
+                    if ( !ch[c].done && ch[c].kind==kind )
+                        chk[nchk++] = &ch[c];
+                if ( nchk && lo<hi )
+                    mid_sum( chk, nchk, tab[kind], lo, hi, w, beta, iter );
+            }
+        }
+
+        for ( int c=0; c<nch; ++c ) {
+            if ( ch[c].done )
+                continue;
+            nterms += nk[ch[c].kind];
+            ndone += mid_channel_check( &ch[c], w, iter );
+        }
+    }
+    for ( int kind=0; kind<2; ++kind )
+        if ( own[kind] )
+            mid_table_free( own[kind] );
+
+    // set diagnostic variables
     kww_algorithm = 2;
-    kww_num_of_terms = 0;
-    if( kww_debug & 4 )
-        // do not iterate, inspect just one sum
-        N = 100;
-    else
-        N = 40;
-
-    for ( iter=0; iter<max_iter_int; ++iter ) {
-        // static initialisation of NN, ak, bk for given 'iter'
-        if ( iter>iterDone[kind][j] ) {
-            if ( N>1e6 )
-                return -3; // integral limits overflow
-            NN[j][iter] = N;
-            if ( !( ak[kind][j][iter]=malloc((sizeof(Xdouble))*(2*N+1)) ) ||
-                 !( bk[kind][j][iter]=malloc((sizeof(Xdouble))*(2*N+1)) )) {
-                fprintf( stderr, "kww: Workspace allocation failed\n" );
-                exit( ENOMEM );
+    kww_num_of_terms = nterms;
+}
+
+Xdouble kww_mid( const double w, const double beta,
+                const int kind, const int mu, const double delta )
+// kind: 0 cos, 1 sin transform (precomputing arrays[2] depend on this)
+{
+    mid_channel ch;
+
+    // check input
+    if ( !( ( kind==0 || kind==1 ) && beta>=0.1 && beta<=2.0 && w>0 ) )
+        return KWW_EDOM;
+
+    // cosine transform for beta=2 is a Gaussian
+    if ( kind==0 && beta==2 )
+        return sqrt(PI)/2*exp(-SQR(w)/4);
+
+    mid_channel_init( &ch, kind, mu, beta, delta );
+    kww_mid_channels( w, beta, &ch, 1 );
+    return ch.ret;
+}
+
+/* Frequencies per tile loop in kww_mid_block: enough to amortize loading
+   a tile of the tables, few enough for their state to stay in L1 cache */
+#define MID_FREQS 16
+
+void kww_mid_block( const int kind, const int mu, const double* w,
+                    const size_t n, const double beta, const double delta,
+                    Xdouble* res )
+{
+    double p;
+    double q;
+    int j;
+
+    if ( kww_debug || !( ( kind==0 || kind==1 ) && beta>=0.1 && beta<=2.0 ) ||
+         ( kind==0 && beta==2 ) ) {
+        // one by one, to see every sum, or to handle trivial cases
+        for ( size_t i=0; i<n; ++i )
+            res[i] = kww_mid( w[i], beta, kind, mu, delta );
+        return;
+    }
+    j = mid_range( beta, &p, &q );
+
+    for ( size_t i0=0; i0<n; i0+=MID_FREQS ) {
+        const int m = n-i0<MID_FREQS ? (int)(n-i0) : MID_FREQS;
+        mid_channel ch[MID_FREQS];
+        mid_channel* chp[MID_FREQS];
+        int nk[MID_FREQS];   // number of nodes to be summed, per frequency
+        int nrun = 0;        // number of unfinished channels
+        for ( int f=0; f<m; ++f ) {
+            mid_channel_init( &ch[f], kind, mu, beta, delta );
+            chp[f] = &ch[f];
+            if ( w[i0+f]>0 )
+                ++nrun;
+            else {
+                ch[f].ret = KWW_EDOM;
+                ch[f].done = 1;
             }
-            iterDone[kind][j] = iter;
-            h = logX( logX( 42*N/kww_delta/Smin ) / p ) / N; // 42=(pi+1)*10
-            isig=1-2*(NN[j][iter]&1);
-            if( kww_debug & 8 ) {
-                printf( "init iter %i kind %i j %i siz %i\n",
-                        iter, kind, j, 2*N+1 );
+        }
+        for ( int iter=0; iter<max_iter_int && nrun; ++iter ) {
+            const kww_mid_table* tab;
+            int nkmax = 0;
+            int err = mid_table_get( &tab, kind, j, iter, p, q );
+            for ( int f=0; f<m; ++f ) {
+                if ( ch[f].done )
+                    continue;
+                if ( err ) {
+                    ch[f].ret = err;
+                    ch[f].done = 1;
+                    continue;
+                }
+                ch[f].S_last = ch[f].S;
+                ch[f].S = 0;
+                ch[f].T = 0;
+                nk[f] = mid_tail( tab, w[i0+f], beta );
+                if ( nk[f]>nkmax )
+                    nkmax = nk[f];
             }
-            for ( kaux=-NN[j][iter]; kaux<=NN[j][iter]; ++kaux ) {
-                k = kaux;
-                if( !kind )
-                    k -= 0.5;
-                u = k*h;
-                chi  = 2*p*sinhX(u) + 2*q*u;
-                dchi = 2*p*coshX(u) + 2*q;
-                if ( u==0 ) {
-                    if ( k!=0 )
-                        return -4; // integration variable underflow
-                    // special treatment to bridge singularity at u=0
-                    ahk = PI/h/dchi;
-                    dhk = 0.5;
-                    chk = sin( ahk );
-                } else {
-                    if ( -chi>DBL_MAX_EXP/2 )
-                        return -5; // integral transformation overflow
-                    e = expX( -chi );
-                    ahk = PI/h * u/(1-e);
-                    dhk = 1/(1-e) - u*e*dchi/SQR(1-e);
-                    chk = e>1 ?
-                        ( kind ? sinX( PI*k/(1-e) ) : cosX( PI*k/(1-e) ) ) :
-                        isig * sinX( PI*k*e/(1-e) );
+            if ( err )
+                break;
+            // each tile of nodes for all frequencies, in the same order
+            // of summation as in kww_mid_channels
+            for ( int lo=0; lo<nkmax; lo+=MID_BLOCK ) {
+                for ( int f=0; f<m; ++f ) {
+                    const int hi = lo+MID_BLOCK < nk[f] ? lo+MID_BLOCK : nk[f];
+                    if ( !ch[f].done && lo<hi )
+                        mid_sum( &chp[f], 1, tab, lo, hi, w[i0+f], beta,
+                                 iter );
                 }
-                ak[kind][j][iter][kaux+NN[j][iter]] = ahk;
-                bk[kind][j][iter][kaux+NN[j][iter]] = dhk * chk;
-                isig = -isig;
             }
+            for ( int f=0; f<m; ++f )
+                if ( !ch[f].done )
+                    nrun -= mid_channel_check( &ch[f], w[i0+f], iter );
         }
-        // integrate according to trapezoidal rule
-        S_last = S;
-        S = 0;
-        T = 0;
-        for ( kaux=-NN[j][iter]; kaux<=NN[j][iter]; ++kaux ) {
-            tk = ak[kind][j][iter][kaux+NN[j][iter]] / w;
-            f = expX(-powX(tk,(Xdouble)beta));
-            if ( diffmode )
-                f -= expX(-SQR(tk));
-            if ( mu )
-                f /= tk;
-            s = bk[kind][j][iter][kaux+NN[j][iter]] * f;
-            S += s;
-            T += fabsX(s);
-            if( kww_debug & 2 )
-                printf( "%2i %6i %12.4Lg %12.4Lg"
-                        " %12.4Lg %12.4Lg %12.4Lg %12.4Lg\n",
-                        iter, kaux, ak[kind][j][iter][kaux+NN[j][iter]],
-                        bk[kind][j][iter][kaux+NN[j][iter]], f, s, S, T );
-        }
-        if( kww_debug & 1 )
-            printf( "%23.17Le  %23.17Le\n", S, T );
-        kww_num_of_terms += 2*NN[j][iter]+1;
-        if ( diffmode )
-            S += w/sqrt(PI)/2*exp(-SQR(w)/4);
-        // termination criteria
-        if      ( kww_debug & 4 )
-            return -1; // we want to inspect just one sum
-        else if ( S < 0 && !diffmode )
-            return -6; // cancelling terms lead to negative S
-        else if ( kww_eps*T > kww_delta*fabsX(S) )
-            return -2; // cancellation
-        else if ( iter && fabsX(S-S_last) + kww_eps*T < kww_delta*fabsX(S) )
-            return S * PI / w; // success (for factor pi/w see my eq. 48)
-        N *= 2; // retry with more points
-    }
-    return -9; // not converged
+        for ( int f=0; f<m; ++f )
+            res[i0+f] = ch[f].ret;
+    }
+}
+
+/* Cosine and sine transform at once. The two node sets differ, but are
+   processed in one pass through the iterations and the tables. */
+void kww_mid_cs( const double w, const double beta, const double delta,
+                 Xdouble* c, Xdouble* s )
+{
+    mid_channel ch[2];
+
+    if ( !( beta>=0.1 && beta<=2.0 && w>0 ) ) {
+        *c = *s = KWW_EDOM;
+        return;
+    }
+
+    if ( beta==2 ) {
+        *c = sqrt(PI)/2*exp(-SQR(w)/4);
+        *s = kww_mid( w, beta, 1, 0, delta );
+        return;
+    }
+
+    mid_channel_init( &ch[0], 0, 0, beta, delta );
+    mid_channel_init( &ch[1], 1, 0, beta, delta );
+    kww_mid_channels( w, beta, ch, 2 );
+    *c = ch[0].ret;
+    *s = ch[1].ret;
+}
+
+/* Sine transform and primitive of cosine transform at once. Both use
+   the same nodes; per node, the integrand is computed only once. */
+void kww_mid_sp( const double w, const double beta, const double delta,
+                 Xdouble* s, Xdouble* p )
+{
+    mid_channel ch[2];
+
+    if ( !( beta>=0.1 && beta<=2.0 && w>0 ) ) {
+        *s = *p = KWW_EDOM;
+        return;
+    }
+
+    mid_channel_init( &ch[0], 1, 0, beta, delta );
+    mid_channel_init( &ch[1], 1, 1, beta, delta );
+    kww_mid_channels( w, beta, ch, 2 );
+    *s = ch[0].ret;
+    *p = ch[1].ret;
 }
 
 Xdouble kwwc_mid( const double w, const double beta )
 {
-    return kww_mid( w, beta, 0, 0 );
+    return kww_mid( w, beta, 0, 0, kww_delta );
 }
 
 Xdouble kwws_mid( const double w, const double beta )
 {
-    return kww_mid( w, beta, 1, 0 );
+    return kww_mid( w, beta, 1, 0, kww_delta );
 }
 
 Xdouble kwwp_mid( const double w, const double beta )
 {
-    return kww_mid( w, beta, 1, 1 );
+    return kww_mid( w, beta, 1, 1, kww_delta );
+}
+
+/*****************************************************************************/
+/*  Derivatives of the cosine transform, for fits                            */
+/*****************************************************************************/
+
+/* Digamma function psi(x) = d lgamma(x)/dx for x>0, from the recurrence
+   psi(x) = psi(x+1) - 1/x and the asymptotic series for x>=20, whose
+   truncation error is below 1e-26. */
+Xdouble kww_psi( Xdouble x )
+{
+    // Bernoulli numbers B_2n/(2n), n=10..1
+    static const Xdouble b[10] = {
+        -174611/(Xdouble)6600, 43867/(Xdouble)14364, -3617/(Xdouble)8160,
+        1/(Xdouble)12, -691/(Xdouble)32760, 1/(Xdouble)132,
+        -1/(Xdouble)240, 1/(Xdouble)252, -1/(Xdouble)120, 1/(Xdouble)12 };
+    Xdouble r = 0;
+    Xdouble z;
+    Xdouble p = 0;
+    while ( x<20 ) {
+        r -= 1/x;
+        x += 1;
+    }
+    z = 1/SQR(x);
+    for ( int n=0; n<10; ++n )
+        p = ( p + b[n] ) * z;
+    return r + logX(x) - 1/(2*x) - p;
+}
+
+// Termination criteria for the sum S of a derivative series, with sum of
+// absolute values T, and with an estimate r of the remainder. Like the
+// criteria for kww_low and kww_hig, but relative to |S|+ref, where ref
+// is the magnitude of the transform in the same units, so that the sum
+// may pass through zero. Returns 1 if S is finished, with 0 or a negative
+// error code in *ret; else returns 0.
+static int deriv_check( const Xdouble S, const Xdouble T, const Xdouble ref,
+                        const Xdouble r, const double delta, int* ret )
+{
+    const Xdouble scale = fabsX(S) + ref;
+    if ( kww_eps*T + r <= delta*scale )
+        *ret = 0; // reached required precision
+    else if ( kww_eps*T >= delta*scale )
+        *ret = -6; // too much cancellation
+    else if ( scale<DBL_MIN )
+        *ret = -7; // underflow
+    else
+        return 0;
+    return 1;
+}
+
+void kww_deriv_coef_init( kww_deriv_coef* dcoef,
+                          const kww_series_coef* coef, const double beta )
+{
+    for ( int k=0; k<max_terms; ++k ) {
+        const Xdouble a = (2*k+1)/(Xdouble)beta;
+        dcoef->low_ratio[k] = k ? expX(coef->low_gl[2*k]-coef->low_gl[2*k-2])
+            : 0;
+        dcoef->low_apsi[k] = a*kww_psi( a );
+        dcoef->hig_ratio[k] = k ? expX(coef->hig_gl[k]-coef->hig_gl[k-1]) : 0;
+        dcoef->hig_psi[k] = kww_psi( k*(Xdouble)beta+1 );
+    }
+}
+
+/* Low-w series of w*d/dw and d/dbeta of kwwc, in d[0], d[1]. The terms
+   of kwwc are multiplied by kk and by -(1+a*psi(a))/beta with a=(kk+1)/beta.
+   With dcoef, which requires coef, terms are obtained by recurrence.
+   Returns 0 or a negative error code. */
+int kww_low_deriv( const double w, const double beta,
+                   const kww_series_coef* coef, const kww_deriv_coef* dcoef,
+                   const double delta, Xdouble* d )
+{
+    int err;
+    int done[2] = { 0, 0 };
+    int ret[2] = { -9, -9 }; // too many terms, unless finished earlier
+    int isig = 1;
+    Xdouble S[3] = { 0, 0, 0 }; // sums for kwwc, d[0], d[1], times beta
+    Xdouble T[3] = { 0, 0, 0 };
+    Xdouble u = 0;
+    Xdouble u_last = 0;
+    Xdouble logw;
+
+    if ( !( beta>=0.1 && beta<=2.0 && w>0 ) )
+        return KWW_EDOM;
+
+    logw = logX((Xdouble)w);
+    for ( int k=0; k<max_terms && !( done[0] && done[1] ); ++k ) {
+        const int kk = 2*k;
+        Xdouble apsi;    // a*psi(a)
+        Xdouble v[3];
+        if ( dcoef ) {
+            // overflow check as in low_term
+            if ( coef->low_gl[kk]+kk*logw > DBL_MAX_EXP/2 )
+                err = -3;
+            else {
+                u = k ? u*dcoef->low_ratio[k]*SQR((Xdouble)w) :
+                    expX( coef->low_gl[0] );
+                err = 0;
+            }
+            apsi = dcoef->low_apsi[k];
+        } else {
+            const Xdouble a = (kk+1)/(Xdouble)beta;
+            err = low_term( &u, kk, 0, beta, logw, coef );
+            apsi = a*kww_psi( a );
+        }
+        if ( err ) {
+            for ( int c=0; c<2; ++c )
+                if ( !done[c] )
+                    ret[c] = err;
+            break;
+        }
+        v[0] = isig*u;
+        v[1] = kk*v[0];
+        v[2] = ( 1+apsi )*v[0];
+        if ( k ) {
+            // 1+|apsi| bounds the factor of d[1], which changes sign
+            for ( int c=0; c<2; ++c )
+                if ( !done[c] )
+                    done[c] = deriv_check( S[c+1], T[c+1],
+                                           ( c ? beta : 1 )*fabsX(S[0]),
+                                           ( c ? 1+fabsX(apsi) : kk )*u,
+                                           delta, &ret[c] );
+            if ( beta<1 && u>u_last ) {
+                for ( int c=0; c<2; ++c )
+                    if ( !done[c] )
+                        ret[c] = -5; // expansion diverges too early
+                break;
+            }
+        }
+        for ( int c=0; c<3; ++c ) {
+            if ( c && done[c-1] )
+                continue;
+            S[c] += v[c];
+            T[c] += fabsX(v[c]);
+        }
+        isig = -isig;
+        u_last = u;
+    }
+    d[0] = S[1]/beta;
+    d[1] = -S[2]/SQR((Xdouble)beta);
+    return ret[0] ? ret[0] : ret[1];
+}
+
+/* High-w series of w*d/dw and d/dbeta of kwwc, in d[0], d[1]. Term k of
+   kwwc, u(k)*sin(pi/2*k*b) with u(k) = Gamma(k*beta+1)/k!*w^(-k*beta-1),
+   is multiplied by -(k*beta+1), or differentiated by beta in u(k) and in
+   the trigonometric factor. With dcoef, which requires coef, terms are
+   obtained by recurrence. Returns 0 or a negative error code. */
+int kww_hig_deriv( const double w, const double beta,
+                   const kww_series_coef* coef, const kww_deriv_coef* dcoef,
+                   const double delta, Xdouble* d )
+{
+    int err;
+    int done[2] = { 0, 0 };
+    int ret[2] = { -9, -9 }; // not converged, unless finished earlier
+    int isig = 1;
+    hig_constants C;
+    Xdouble S[3] = { 0, 0, 0 }; // sums for kwwc, d[0], d[1]
+    Xdouble T[3] = { 0, 0, 0 };
+    Xdouble u = 0;
+    Xdouble u_last = 0;
+    Xdouble rfac;     // for the remainder estimate, as in hig_series_add
+    Xdouble logw;
+    Xdouble wb;       // w^-beta
+    Xdouble db;       // derivative of C.b by beta
+
+    if ( !( beta>=0.1 && beta<=2.0 && w>0 ) )
+        return KWW_EDOM;
+
+    hig_constants_init( &C, beta, coef );
+    // for beta=2, all terms of kwwc and d[0] vanish: the Gaussian has no
+    // high-w expansion
+    if ( beta==2 ) {
+        done[0] = 1;
+        ret[0] = 0;
+    }
+    db = beta<1 ? 1 : -1;
+    rfac = C.truncfac/C.sinphi;
+    logw = logX((Xdouble)w);
+    wb = expX( -beta*logw );
+    for ( int k=1; k<max_terms && !( done[0] && done[1] ); ++k ) {
+        const Xdouble x = k*(Xdouble)beta+1;
+        Xdouble dlu;      // d log(u(k))/dbeta
+        Xdouble v[3];
+        Xdouble sn, cs;
+        if ( dcoef ) {
+            // overflow check as in hig_term
+            if ( coef->hig_gl[k]-x*logw > DBL_MAX_EXP/2 )
+                err = -3;
+            else {
+                u = k>1 ? u*dcoef->hig_ratio[k]*wb :
+                    expX( coef->hig_gl[1]-x*logw );
+                err = 0;
+            }
+            dlu = k*( dcoef->hig_psi[k] - logw );
+        } else {
+            err = hig_term( &u, k, 0, beta, logw, coef );
+            dlu = k*( kww_psi( x ) - logw );
+        }
+        if ( err ) {
+            for ( int c=0; c<2; ++c )
+                if ( !done[c] )
+                    ret[c] = err;
+            break;
+        }
+        sn = coef ? coef->hig_trig[0][k] : sinX(PI_2*k*C.b);
+        cs = coef ? coef->hig_trig[1][k] : cosX(PI_2*k*C.b);
+        v[0] = isig*u*sn;
+        v[1] = -x*v[0];
+        v[2] = isig*u*( dlu*sn + db*PI_2*k*cs );
+        if ( k>1 ) {
+            rfac *= C.truncfac;
+            for ( int c=0; c<2; ++c )
+                if ( !done[c] )
+                    done[c] = deriv_check( S[c+1], T[c+1], fabsX(S[0]),
+                                           ( c ? fabsX(dlu)+PI_2*k : x )
+                                           *u*rfac, delta, &ret[c] );
+            if ( beta>1 && u*C.truncfac>u_last ) {
+                for ( int c=0; c<2; ++c )
+                    if ( !done[c] )
+                        ret[c] = -5; // expansion diverges too early
+                break;
+            }
+        }
+        for ( int c=0; c<3; ++c ) {
+            if ( c && done[c-1] )
+                continue;
+            S[c] += v[c];
+            T[c] += fabsX(v[c]);
+        }
+        if ( C.alternating )
+            isig = -isig;
+        u_last = u;
+    }
+    d[0] = S[1];
+    d[1] = S[2];
+    return ret[0] ? ret[0] : ret[1];
+}
+
+/* Numeric integration of kwwc, w*d/dw and d/dbeta of kwwc at once, with
+   integrands exp(-t^beta) times 1, beta*t^beta-1, and -t^beta*log(t), so
+   that the costly exponentials are shared. Stores kwwc or an error code
+   in *c, as kww_mid would, and the derivatives in d[0], d[1]; returns 0
+   or the error code of a derivative. */
+int kww_mid_deriv( const double w, const double beta, const double delta,
+                   Xdouble* c, Xdouble* d )
+{
+    mid_channel ch[3];
+
+    if ( !( beta>=0.1 && beta<=2.0 && w>0 ) ) {
+        *c = KWW_EDOM;
+        return KWW_EDOM;
+    }
+
+    for ( int k=0; k<3; ++k ) {
+        mid_channel_init( &ch[k], 0, 0, beta, delta );
+        if ( k ) {
+            ch[k].deriv = k==1 ? KWW_MID_DW : KWW_MID_DB;
+            ch[k].ref = &ch[0].S;
+        }
+    }
+    // no transform of the counterpart of the Gaussian is known
+    ch[2].diffmode = 0;
+    if ( beta==2 ) {
+        // only d/dbeta needs integration; the Gaussian and w times its
+        // derivative are known, and the sum for the reference is set
+        *c = sqrt(PI)/2*exp(-SQR(w)/4);
+        ch[0].S = *c * w / PI;
+        ch[1].ret = -SQR(w)/2 * *c;
+        ch[1].ok = 1;
+        kww_mid_channels( w, beta, &ch[2], 1 );
+    } else {
+        kww_mid_channels( w, beta, ch, 3 );
+        *c = ch[0].ret;
+    }
+    for ( int k=1; k<3; ++k )
+        if ( !ch[k].ok )
+            return ch[k].ret;
+    d[0] = ch[1].ret;
+    d[1] = ch[2].ret;
+    return 0;
 }
@@ -0,0 +1,154 @@
+/* kww_mid_simd.c:
+ *   Trapezoid sums of kww_mid, vectorized with AVX2 or AVX-512,
+ *   in double-double arithmetic.
+ *   Not compiled directly, but included from kww_avx2.c and kww_avx512.c,
+ *   after kww_simd_dd.c, with KWW_MID_SIMD_NAME set to the name of the
+ *   exported function.
+ *
+ * Copyright:
+ *   (C) 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ *
+ * Reference:
+ *   Wuttke, Algorithms 5, 604-628 (2012), doi:10.3390/a5040604
+ */
+
+#include "kww_plan.h"
+
+#ifdef KWW_MID_SIMD_NAME
+
+#include "kww_simd_dd.c"
+
+/*****************************************************************************/
+/*  Trapezoid sum                                                            */
+/*****************************************************************************/
+
+// Adds hi+lo to the double-double number s[0]+s[1]
+static void dd_sum( double* s, const double hi, const double lo )
+{
+    double t = s[0]+hi;
+    const double bb = t-s[0];
+    double e = ( s[0]-(t-bb) ) + ( hi-bb ) + s[1] + lo;
+    s[0] = t+e;
+    s[1] = e-(s[0]-t);
+}
+
+// Lane-wise sums over nodes lo..lo+WIDTH-1, read from the given pointers.
+static inline void mid_simd_step( const double* akh, const double* akl,
+                                  const double* bkh, const double* bkl,
+                                  const double* lakh, const double* lakl,
+                                  const vdd winv, const vdd mlogw,
+                                  const double beta,
+                                  const int nch, const int* mu,
+                                  const int* deriv, const int* diffmode,
+                                  vdd* S, vdd* T )
+{
+    const vdd ak = { V_LOAD( akh ), V_LOAD( akl ) };
+    const vdd bk = { V_LOAD( bkh ), V_LOAD( bkl ) };
+    const vdd lak = { V_LOAD( lakh ), V_LOAD( lakl ) };
+    const vdd tk = dd_mul( ak, winv );
+    const vdd ltk = dd_add( lak, mlogw );
+    const vdd x = dd_exp( dd_mul_d( ltk, V_SET1( beta ) ) );
+    const vdd f0 = dd_exp( dd_neg( x ) );
+    for ( int c=0; c<nch; ++c ) {
+        vdd f = f0;
+        vdd s;
+        if ( deriv[c]==KWW_MID_DW )
+            f = dd_mul( f, dd_add_d( dd_mul_d( x, V_SET1( beta ) ),
+                                     V_SET1( -1. ) ) );
+        else if ( deriv[c]==KWW_MID_DB )
+            f = dd_mul( f, dd_neg( dd_mul( x, ltk ) ) );
+        if ( diffmode[c] ) {
+            const vdd tk2 = dd_mul( tk, tk );
+            vdd g = dd_exp( dd_neg( tk2 ) );
+            if ( deriv[c] )
+                g = dd_mul( g, dd_add_d( dd_scale( tk2, 2 ), V_SET1( -1. ) ) );
+            f = dd_add( f, dd_neg( g ) );
+        }
+        if ( mu[c] )
+            f = dd_div( f, tk );
+        s = dd_mul( bk, f );
+        S[c] = dd_add( S[c], s );
+        T[c] = dd_add( T[c], dd_abs( s ) );
+    }
+}
+
+void KWW_MID_SIMD_NAME( const kww_mid_split* tab, const int lo, const int hi,
+                        const double w, const double beta, const int nch,
+                        const int* mu, const int* deriv, const int* diffmode,
+                        double* S, double* T )
+{
+    int i;
+    vdd vS[KWW_MID_SIMD_MAX_CH];
+    vdd vT[KWW_MID_SIMD_MAX_CH];
+    vdd winv;
+    vdd mlogw;
+
+    // 1/w and -log(w) in double-double
+    {
+        const double q1 = 1/w;
+        const double r = -fma( q1, w, -1. );
+        winv.hi = V_SET1( q1 );
+        winv.lo = V_SET1( r/w );
+        mlogw = dd_neg( dd_log( (vdd){ V_SET1( w ), V_SET1( 0. ) } ) );
+    }
+    for ( int c=0; c<nch; ++c )
+        vS[c] = vT[c] = (vdd){ V_SET1( 0. ), V_SET1( 0. ) };
+
+    for ( i=lo; i+WIDTH<=hi; i+=WIDTH )
+        mid_simd_step( tab->ak_hi+i, tab->ak_lo+i, tab->bk_hi+i, tab->bk_lo+i,
+                       tab->lak_hi+i, tab->lak_lo+i,
+                       winv, mlogw, beta, nch, mu, deriv, diffmode, vS, vT );
+    if ( i<hi ) {
+        // pad the last vector with harmless nodes of weight 0
+        double buf[6][WIDTH];
+        for ( int l=0; l<WIDTH; ++l ) {
+            buf[0][l] = i+l<hi ? tab->ak_hi[i+l] : 1;
+            buf[1][l] = i+l<hi ? tab->ak_lo[i+l] : 0;
+            buf[2][l] = i+l<hi ? tab->bk_hi[i+l] : 0;
+            buf[3][l] = i+l<hi ? tab->bk_lo[i+l] : 0;
+            buf[4][l] = i+l<hi ? tab->lak_hi[i+l] : 0;
+            buf[5][l] = i+l<hi ? tab->lak_lo[i+l] : 0;
+        }
+        mid_simd_step( buf[0], buf[1], buf[2], buf[3], buf[4], buf[5],
+                       winv, mlogw, beta, nch, mu, deriv, diffmode, vS, vT );
+    }
+
+    // sum over lanes, in fixed order so that results are reproducible
+    for ( int c=0; c<nch; ++c ) {
+        double sh[WIDTH], sl[WIDTH], th[WIDTH], tl[WIDTH];
+        V_STORE( sh, vS[c].hi );
+        V_STORE( sl, vS[c].lo );
+        V_STORE( th, vT[c].hi );
+        V_STORE( tl, vT[c].lo );
+        S[2*c] = S[2*c+1] = T[2*c] = T[2*c+1] = 0;
+        for ( int l=0; l<WIDTH; ++l ) {
+            dd_sum( &S[2*c], sh[l], sl[l] );
+            dd_sum( &T[2*c], th[l], tl[l] );
+        }
+    }
+}
+
+#endif // KWW_MID_SIMD_NAME
@@ -0,0 +1,180 @@
+/* kww_mktables.c:
+ *   Generates the tables of kww_mid for the first iterations, to be
+ *   compiled into the library as read-only data.
+ *   Built and run at build time; not part of the library.
+ *
+ * Copyright:
+ *   (C) 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ *
+ * Reference:
+ *   Wuttke, Algorithms 5, 604-628 (2012), doi:10.3390/a5040604
+ */
+
+// The tables are computed by the very code that computes them at run time
+// otherwise, with the same numeric type and the same compiler options, so
+// that results do not depend on whether tables are generated.
+#include <stdio.h>
+#include <stdlib.h>
+#include "kww_lowlevel.c"
+
+#define PER_LINE 3
+
+// Prints x as a hexadecimal floating constant, which is exact.
+static void print_x( FILE* f, const Xdouble x )
+{
+#ifdef USE_FLOAT128
+    char buf[64];
+    quadmath_snprintf( buf, sizeof(buf), "%Qa", x );
+    fprintf( f, "%sQ", buf );
+#else
+    fprintf( f, "%LaL", x );
+#endif
+}
+
+static void print_array( FILE* f, const char* type, const char* name,
+                         const int kind, const int j, const int iter,
+                         const Xdouble* x, const int n, const int dbl )
+{
+    // __extension__ allows for the non-standard suffix Q of float128
+    fprintf( f, "__extension__ static const %s %s_%i_%i_%i[%i] = {",
+             type, name, kind, j, iter, n );
+    for ( int i=0; i<n; ++i ) {
+        fprintf( f, i%PER_LINE ? " " : "\n   " );
+        if ( dbl )
+            fprintf( f, "%a", (double)x[i] );
+        else
+            print_x( f, x[i] );
+        fprintf( f, i<n-1 ? "," : "\n" );
+    }
+    fprintf( f, "};\n" );
+}
+
+// Prints the hi+lo doubles of ak, bk, lak, in the layout of mid_table_new.
+static void print_split( FILE* f, const kww_mid_table* tab, const int kind,
+                         const int j, const int iter )
+{
+    const int n = 2*tab->N+1;
+    const Xdouble* x[3] = { tab->ak, tab->bk, tab->lak };
+    Xdouble* buf = malloc( sizeof(Xdouble)*6*n );
+    if ( !buf ) {
+        fprintf( stderr, "allocation failed\n" );
+        exit(1);
+    }
+    for ( int a=0; a<3; ++a ) {
+        for ( int i=0; i<n; ++i ) {
+            const double hi = (double)x[a][i];
+            buf[2*a*n+i] = hi;
+            buf[(2*a+1)*n+i] = (double)( x[a][i]-hi );
+        }
+    }
+    print_array( f, "double", "mid_split", kind, j, iter, buf, 6*n, 1 );
+    free( buf );
+}
+
+int main( int argc, char **argv )
+{
+    int niter;
+    FILE* f;
+
+    if( argc!=3 ){
+        fprintf( stderr,  "usage:\n" );
+        fprintf( stderr,  "   %s <niter> <file>\n", argv[0] );
+        fprintf( stderr,  "with arguments:\n" );
+        fprintf( stderr,  "   <niter>: number of iterations to be tabulated,"
+                 " at most %i\n", max_iter_int );
+        fprintf( stderr,  "   <file>: output, to be included by"
+                 " kww_lowlevel.c\n" );
+        exit(-1);
+    }
+    niter = atoi(argv[1]);
+    if( niter<1 || niter>max_iter_int ){
+        fprintf( stderr,  "<niter> must be in 1..%i\n", max_iter_int );
+        exit(-1);
+    }
+    if( !( f = fopen( argv[2], "w" ) ) ){
+        fprintf( stderr,  "cannot open %s\n", argv[2] );
+        exit(1);
+    }
+
+    fprintf( f, "/* kww_mid_tables.h:\n"
+             " *   Tables of kww_mid for iterations 0..%i.\n"
+             " *   Generated by kww_mktables; do not edit.\n"
+             " */\n\n", niter-1 );
+    fprintf( f, "#define KWW_MID_TABLE_ITER %i\n\n", niter );
+    for ( int kind=0; kind<2; ++kind ) {
+        for ( int j=0; j<num_range; ++j ) {
+            for ( int iter=0; iter<niter; ++iter ) {
+                kww_mid_table* tab;
+                int n;
+                if ( mid_table_new( &tab, kind, 40<<iter,
+                                    mid_p[j], mid_q[j] ) ) {
+                    fprintf( stderr,  "cannot compute table kind %i j %i"
+                             " iter %i\n", kind, j, iter );
+                    exit(1);
+                }
+                n = 2*tab->N+1;
+                print_array( f, "Xdouble", "mid_ak", kind, j, iter,
+                             tab->ak, n, 0 );
+                print_array( f, "Xdouble", "mid_lak", kind, j, iter,
+                             tab->lak, n, 0 );
+                print_array( f, "Xdouble", "mid_bk", kind, j, iter,
+                             tab->bk, n, 0 );
+                fprintf( f, "#ifdef KWW_SIMD\n" );
+                print_split( f, tab, kind, j, iter );
+                fprintf( f, "#endif\n\n" );
+                mid_table_free( tab );
+            }
+        }
+    }
+
+    fprintf( f, "#ifdef KWW_SIMD\n"
+             "#define MID_SPLIT(s) , s\n"
+             "#else\n"
+             "#define MID_SPLIT(s)\n"
+             "#endif\n\n" );
+    fprintf( f, "static const kww_mid_table"
+             " mid_tables_pre[2][%i][KWW_MID_TABLE_ITER] = {\n", num_range );
+    for ( int kind=0; kind<2; ++kind ) {
+        fprintf( f, "  {\n" );
+        for ( int j=0; j<num_range; ++j ) {
+            fprintf( f, "    {\n" );
+            for ( int iter=0; iter<niter; ++iter )
+                fprintf( f, "      { %i, mid_ak_%i_%i_%i, mid_lak_%i_%i_%i,"
+                         " mid_bk_%i_%i_%i MID_SPLIT(mid_split_%i_%i_%i) },\n",
+                         40<<iter, kind, j, iter, kind, j, iter,
+                         kind, j, iter, kind, j, iter );
+            fprintf( f, "    },\n" );
+        }
+        fprintf( f, "  },\n" );
+    }
+    fprintf( f, "};\n\n#undef MID_SPLIT\n" );
+
+    if( fclose( f ) ){
+        fprintf( stderr,  "cannot write %s\n", argv[2] );
+        exit(1);
+    }
+    return 0;
+}
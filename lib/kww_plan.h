@@ -0,0 +1,293 @@
+/* kww_plan.h:
+ *   Internal layout of the per-beta plan, and the low-level calls using it.
+ *   Not installed.
+ *
+ * Copyright:
+ *   (C) 2009, 2012, 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ *
+ * Reference:
+ *   Wuttke, Algorithms 5, 604-628 (2012), doi:10.3390/a5040604
+ */
+
+#ifndef __KWW_PLAN_H__
+#define __KWW_PLAN_H__
+
+#include <stddef.h>
+#include "extended_double.h"
+
+#define KWW_MAX_TERMS 200
+
+/* Beta-dependent coefficients of the series expansions. With these,
+   the k-th term is obtained as expX( gl[k] + (k+mu)*log(w) ). */
+typedef struct {
+    // low-w: lgamma((kk+1)/beta) - lgamma(kk+1), for kk=2*k+kappa
+    Xdouble low_gl[2*KWW_MAX_TERMS];
+    // high-w: lgamma(k*beta+1) - lgamma(k+1)
+    Xdouble hig_gl[KWW_MAX_TERMS+1];
+    // high-w: sin(pi/2*k*b) for kappa=0, cos(pi/2*k*b) for kappa=1
+    Xdouble hig_trig[2][KWW_MAX_TERMS];
+    // high-w: sin(pi/(2*beta)) and its power -beta (1 if beta<1)
+    Xdouble sinphi;
+    Xdouble truncfac;
+#ifdef KWW_SIMD
+    // for the vectorized kernel: low_gl, hig_gl rounded to double; the
+    // ratios exp(low_gl[kk]-low_gl[kk-2]) and exp(hig_gl[k]-hig_gl[k-1]) of
+    // successive coefficients, with low_gl[-2]=low_gl[-1]=hig_gl[-1]=0,
+    // and hig_trig[kappa], split into hi+lo doubles
+    double low_gl_d[2*KWW_MAX_TERMS];
+    double low_ratio_dd[2][2*KWW_MAX_TERMS];
+    double hig_gl_d[KWW_MAX_TERMS+1];
+    double hig_ratio_dd[2][KWW_MAX_TERMS+1];
+    double hig_trig_dd[2][2][KWW_MAX_TERMS];
+#endif
+} kww_series_coef;
+
+struct kww_plan {
+    double beta;
+    double delta;      // relative tolerance
+    double lim_low[3]; // range limits for kwwc, kwws, kwwp
+    double lim_hig[3];
+    kww_series_coef coef;
+};
+
+/* Computing a plan costs about as much as a few dozen scalar calls. */
+#define KWW_PLAN_MIN_SIZE 64
+
+void kww_series_coef_init( kww_series_coef* coef, const double beta );
+
+/* From kww_lowlevel.c: default relative tolerance, and precision of the
+   extended-precision arithmetic. */
+extern const double kww_delta, kww_eps;
+
+/* From kww.c. kind is one of KWW_C, KWW_S, KWW_P. */
+int kww_beta_ok( const double beta );
+int kww_at( const int kind, double* res,
+            const double w_in, const double beta,
+            const double lim_low, const double lim_hig,
+            const kww_series_coef* coef, const double delta );
+
+/* Batch driver, from kww_batch.c. Calls eval( ctx, j, i ) for all rows
+   j<nrow and points i<n, and returns the number of nonzero results.
+   Runs in parallel if built with OpenMP. Work is split into chunks of
+   about equal predicted cost, numeric integrations first, where w[i] needs
+   numeric integration in row j if it lies between lim_low[j*nlim+k] and
+   lim_hig[j*nlim+k] for any k<nlim. */
+typedef int kww_batch_eval( void* ctx, const size_t j, const size_t i );
+size_t kww_batch_run( const double* w, const size_t n, const size_t nrow,
+                      const int nlim,
+                      const double* lim_low, const double* lim_hig,
+                      kww_batch_eval* eval, void* ctx );
+
+/* Evaluates kind at all w[i] in the range of a series expansion, in blocks
+   of neighbouring points, as kww_at would, and sets done[i]=1, except
+   where the series fails, so that numeric integration is needed.
+   out may be the same array as w. */
+void kww_batch_series( const int kind, const double* w, const size_t n,
+                       const double beta,
+                       const double lim_low, const double lim_hig,
+                       const kww_series_coef* coef, const double delta,
+                       double* out, char* done );
+
+/* Numeric integration for the points i of w[0..n-1] not yet done[i],
+   in blocks of frequencies that share the quadrature tables; sets out[i]
+   and done[i]=1 where successful, so that only failures remain for kww_at.
+   out may be the same array as w. */
+void kww_batch_mid( const int kind, const double* w, const size_t n,
+                    const double beta, const double delta,
+                    double* out, char* done );
+
+/* As in kww_lowlevel.c, with optional precomputed coefficients (or NULL),
+   and with relative tolerance delta (kww_delta for full precision) */
+Xdouble kww_low( const double w, const double beta,
+                 const int kappa, const int mu, const kww_series_coef* coef,
+                 const double delta );
+Xdouble kww_hig( const double w, const double beta,
+                 const int kappa, const int mu, const kww_series_coef* coef,
+                 const double delta );
+Xdouble kwwp_hig_coef( const double w, const double beta,
+                       const kww_series_coef* coef, const double delta );
+Xdouble kww_mid( const double w, const double beta,
+                 const int kind, const int mu, const double delta );
+
+/* kww_mid for n frequencies w[i], in blocks that share each tile of the
+   quadrature tables; results or error codes in res[i] */
+void kww_mid_block( const int kind, const int mu, const double* w,
+                    const size_t n, const double beta, const double delta,
+                    Xdouble* res );
+
+/* Builds the kww_mid tables of both kinds for beta_min..beta_max and
+   iterations 0..niter-1, unless they exist; returns 0 or an error code */
+int kww_mid_tables_init( const double beta_min, const double beta_max,
+                         const int niter );
+/* Releases all kww_mid tables built at run time */
+void kww_mid_tables_free( void );
+
+/* Cosine and sine transform at once; results or error codes in *c, *s */
+void kww_low_cs( const double w, const double beta,
+                 const kww_series_coef* coef, const double delta,
+                 Xdouble* c, Xdouble* s );
+void kww_hig_cs( const double w, const double beta,
+                 const kww_series_coef* coef, const double delta,
+                 Xdouble* c, Xdouble* s );
+void kww_mid_cs( const double w, const double beta, const double delta,
+                 Xdouble* c, Xdouble* s );
+
+/* Sine transform and primitive at once */
+void kww_mid_sp( const double w, const double beta, const double delta,
+                 Xdouble* s, Xdouble* p );
+
+/* Further beta-dependent coefficients for the series of the derivatives
+   of kwwc, computed per batch: ratios of successive terms, so that these
+   are obtained by recurrence, and values of the digamma function psi. */
+typedef struct {
+    Xdouble low_ratio[KWW_MAX_TERMS]; // exp(low_gl[2*k]-low_gl[2*k-2])
+    Xdouble low_apsi[KWW_MAX_TERMS];  // a*psi(a) for a=(2*k+1)/beta
+    Xdouble hig_ratio[KWW_MAX_TERMS]; // exp(hig_gl[k]-hig_gl[k-1])
+    Xdouble hig_psi[KWW_MAX_TERMS];   // psi(k*beta+1)
+} kww_deriv_coef;
+
+void kww_deriv_coef_init( kww_deriv_coef* dcoef,
+                          const kww_series_coef* coef, const double beta );
+
+/* Derivatives of kwwc, for kwwc_deriv_at: d[0] = w*d/dw, d[1] = d/dbeta,
+   accurate to delta relative to the larger of their magnitude and kwwc;
+   return 0 or a negative error code. dcoef may be NULL, and requires coef
+   otherwise. kww_mid_deriv also computes kwwc, as kww_mid would. */
+int kww_low_deriv( const double w, const double beta,
+                   const kww_series_coef* coef, const kww_deriv_coef* dcoef,
+                   const double delta, Xdouble* d );
+int kww_hig_deriv( const double w, const double beta,
+                   const kww_series_coef* coef, const kww_deriv_coef* dcoef,
+                   const double delta, Xdouble* d );
+int kww_mid_deriv( const double w, const double beta, const double delta,
+                   Xdouble* c, Xdouble* d );
+
+/* Integrands of kww_mid channels: exp(-t^beta) times beta*t^beta-1 for
+   w times the derivative by w, or times -t^beta*log(t) for the derivative
+   by beta */
+#define KWW_MID_DW 1
+#define KWW_MID_DB 2
+
+/* Digamma function, for x>0 */
+Xdouble kww_psi( Xdouble x );
+
+/* Series expansion at n frequencies w[i]>0 at once, vectorized if possible:
+   res[i] as from kww_low( w[i], beta, kappa, mu, coef, delta ) if hig=0,
+   else as from kww_hig, or as from kwwp_hig_coef if mu=1. */
+void kww_series_block( const int hig, const int kappa, const int mu,
+                       const double* w, const size_t n, const double beta,
+                       const kww_series_coef* coef, const double delta,
+                       Xdouble* res );
+
+/* Vectorized kernels, from kww_avx2.c and kww_avx512.c. Compiled for
+   x86-64 unless disabled by option; kww_lowlevel.c chooses one set at
+   load time, according to the CPU. */
+#ifdef KWW_SIMD
+
+#define KWW_MID_SIMD_MAX_CH 3
+
+/* Nodes ak, log(ak), and weights bk of a kww_mid table, split into hi+lo
+   doubles */
+typedef struct {
+    const double* ak_hi;
+    const double* ak_lo;
+    const double* bk_hi;
+    const double* bk_lo;
+    const double* lak_hi;
+    const double* lak_lo;
+} kww_mid_split;
+
+/* Sums bk*f over nodes lo..hi-1, where f = exp(-tk^beta) with tk=ak/w,
+   and tk^beta = exp(beta*(log(ak)-log(w))), times the factor of
+   deriv[c] if nonzero, minus exp(-tk^2) (times 2*tk^2-1 if deriv[c])
+   if diffmode[c], divided by tk if mu[c], for nch channels c. Returns
+   the sums of s=bk*f and of |s| as double-double numbers in S[2*c],
+   S[2*c+1] and T[2*c], T[2*c+1]. */
+typedef void kww_mid_sum_simd_fn( const kww_mid_split* tab,
+                                  const int lo, const int hi,
+                                  const double w, const double beta,
+                                  const int nch, const int* mu,
+                                  const int* deriv, const int* diffmode,
+                                  double* S, double* T );
+kww_mid_sum_simd_fn kww_mid_sum_avx2;
+kww_mid_sum_simd_fn kww_mid_sum_avx512;
+
+/* Low- or high-w series of kww_low, kww_hig with given kappa, mu, and
+   with coefficients from a kww_series_coef, or computed in the same way:
+   gl is low_gl_d, indexed by kk, or hig_gl_d, indexed by k, and is only
+   needed to detect overflow; ratio[0..1] is low_ratio_dd or hig_ratio_dd,
+   trig[0..1] is hig_trig_dd[kappa]. Term k is obtained as term k-1 times
+   ratio[k] times w^2 (low-w) or w^-beta (high-w), so that the series is a
+   polynomial in w^2 or w^-beta. */
+typedef struct {
+    int hig;           // 0 for low-w, 1 for high-w series
+    int kappa;         // 0 for cosine, 1 for sine transform
+    int mu;            // 1 for primitive
+    int alternating;   // high-w: has factor (-)^k
+    double beta;
+    double delta;      // relative tolerance
+    double truncfac;   // high-w: for termination criterion
+    double rfac;       // high-w: initial factor of remainder estimate
+    const double* gl;
+    const double* ratio[2];
+    const double* trig[2];
+} kww_series_job;
+
+/* State of up to KWW_SERIES_LANES series, one per frequency, that are
+   summed in parallel. The caller sets w and res, and i=0; each call of
+   the kernel then adds terms i..i_end-1, for all lanes that are still
+   running. Once a lane has finished, res+res_lo holds the result or a
+   negative error code, and nterms the number of terms, as in kww_low,
+   kww_hig. */
+#define KWW_SERIES_LANES 8
+typedef struct {
+    int i;                          // terms computed so far
+    double w[KWW_SERIES_LANES];     // frequency, normal and positive
+    double res[KWW_SERIES_LANES];   // result; NaN while running
+    double res_lo[KWW_SERIES_LANES]; // low part of the result
+    int nterms[KWW_SERIES_LANES];
+    double lw[KWW_SERIES_LANES];    // log(w)
+    double q[2][KWW_SERIES_LANES];  // w^2 or w^-beta
+    double v[2][KWW_SERIES_LANES];  // term k, without division for mu
+    double u[2][KWW_SERIES_LANES];  // last term received, not yet summed
+    double S[2][KWW_SERIES_LANES];  // summed series
+    double T[2][KWW_SERIES_LANES];  // sum of absolute values
+    double isig[KWW_SERIES_LANES];  // alternating sign
+    double rfac[KWW_SERIES_LANES];  // for computation of remainder
+} kww_series_lanes;
+
+/* Returned in res if the result is too small for double-double
+   arithmetic, so that the series must be redone in extended precision */
+#define KWW_SIMD_REDO -100
+
+/* Returns the number of lanes still running */
+typedef int kww_series_simd_fn( const kww_series_job* J, kww_series_lanes* L,
+                                const int i_end );
+kww_series_simd_fn kww_series_avx2;
+kww_series_simd_fn kww_series_avx512;
+#endif
+
+#endif /* __KWW_PLAN_H__ */
@@ -0,0 +1,226 @@
+/* kww_series_simd.c:
+ *   Series expansions of kww_low and kww_hig for several frequencies at
+ *   once, one per lane, vectorized with AVX2 or AVX-512, in double-double
+ *   arithmetic.
+ *   Not compiled directly, but included from kww_avx2.c and kww_avx512.c,
+ *   with KWW_SERIES_SIMD_NAME set to the name of the exported function.
+ *
+ * Copyright:
+ *   (C) 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ *
+ * Reference:
+ *   Wuttke, Algorithms 5, 604-628 (2012), doi:10.3390/a5040604
+ */
+
+#include "kww_plan.h"
+
+#ifdef KWW_SERIES_SIMD_NAME
+
+#include <float.h>
+#include "kww_simd_dd.c"
+
+/* Results below this bound are not resolved by double-double arithmetic,
+   and are therefore redone in extended precision. */
+#define DD_TINY 0x1p-900
+
+// Element i of a split table, in all lanes
+static inline vdd dd_bcast( const double* const* t, const int i )
+{
+    return (vdd){ V_SET1( t[0][i] ), V_SET1( t[1][i] ) };
+}
+
+static inline vdd dd_load( double (*x)[KWW_SERIES_LANES], const int l0 )
+{
+    return (vdd){ V_LOAD( x[0]+l0 ), V_LOAD( x[1]+l0 ) };
+}
+
+static inline void dd_store( double (*x)[KWW_SERIES_LANES], const int l0,
+                             const vdd a )
+{
+    V_STORE( x[0]+l0, a.hi );
+    V_STORE( x[1]+l0, a.lo );
+}
+
+// Adds terms L->i..i_end-1 to lanes l0..l0+WIDTH-1 of L, as long as they
+// are running. Same algorithm as low_series_add and hig_series_add, with
+// the termination criteria evaluated lane-wise. Returns the bit mask of
+// lanes still running.
+static int series_simd_vec( const kww_series_job* J, kww_series_lanes* L,
+                            const int l0, const int i_end )
+{
+    const V zero = V_SET1( 0. );
+    const V eps = V_SET1( kww_eps );
+    const V delta = V_SET1( J->delta );
+    V res = V_LOAD( L->res+l0 );
+    V res_lo = V_LOAD( L->res_lo+l0 );
+    int run = V_CMP( res, res, _CMP_UNORD_Q );
+    V lw, isig, rfac;
+    vdd q, v, u, S, T;
+
+    if ( !run )
+        return 0;
+    if ( L->i==0 ) {
+        // factor q, and first term; ratio[0..step-1] holds exp(gl[0..])
+        const V w = V_LOAD( L->w+l0 );
+        if ( !J->hig ) {
+            lw = d_log( w );
+            q = two_prod( w, w );
+            v = dd_bcast( J->ratio, J->kappa );
+            if ( J->kappa+J->mu )
+                v = dd_mul_d( v, w );
+        } else {
+            const vdd lwd = dd_log( (vdd){ w, zero } );
+            lw = lwd.hi;
+            q = dd_exp( dd_mul_d( lwd, V_SET1( -J->beta ) ) );
+            v = J->mu ? (vdd){ V_SET1( 1. ), zero } :
+                dd_div( (vdd){ V_SET1( 1. ), zero }, (vdd){ w, zero } );
+            if ( !J->kappa )
+                v = dd_mul( v, dd_mul( dd_bcast( J->ratio, 1 ), q ) );
+        }
+        u = S = T = (vdd){ zero, zero };
+        isig = V_SET1( 1. );
+        rfac = V_SET1( J->rfac );
+    } else {
+        lw = V_LOAD( L->lw+l0 );
+        q = dd_load( L->q, l0 );
+        v = dd_load( L->v, l0 );
+        u = dd_load( L->u, l0 );
+        S = dd_load( L->S, l0 );
+        T = dd_load( L->T, l0 );
+        isig = V_LOAD( L->isig+l0 );
+        rfac = V_LOAD( L->rfac+l0 );
+    }
+
+    for ( int i=L->i; i<i_end && run; ++i ) {
+        vdd un;           // next term
+        vdd r;            // result or error code, if finished
+        int over;         // gamma function overflow
+        int fin;          // lanes finished in this step
+        // next term, by recursion; the exponent as in low_term or hig_term
+        // is still needed to detect overflow
+        {
+            int idx;      // kk or k
+            double e;     // exponent of w
+            vdd div;      // divisor, for the primitive
+            if ( !J->hig ) {
+                idx = 2*i+J->kappa;
+                e = idx+J->mu;
+                div = (vdd){ V_SET1( idx+1 ), zero };
+            } else {
+                idx = 1-J->kappa+i;
+                e = J->mu-1-idx*J->beta;
+                div = two_prod( V_SET1( idx ), V_SET1( J->beta ) );
+            }
+            over = run & V_CMP( V_FMA( lw, V_SET1( e ),
+                                       V_SET1( J->gl[idx] ) ),
+                                V_SET1( DBL_MAX_EXP/2 ), _CMP_GT_OQ );
+            if ( i>0 )
+                v = dd_mul( v, dd_mul( dd_bcast( J->ratio, idx ), q ) );
+            un = J->mu ? dd_div( v, div ) : v;
+        }
+        if ( i==0 ) {
+            // nothing to sum yet
+            fin = over;
+            r = (vdd){ V_SET1( -3. ), zero };
+        } else {
+            int conv, canc, dvg, unfl, ok;
+            V Sabs;
+            if ( !J->hig ) {
+                S = dd_add( S, (vdd){ V_MUL( isig, u.hi ),
+                                      V_MUL( isig, u.lo ) } );
+                T = dd_add( T, u );
+                Sabs = dd_abs( S ).hi;
+                conv = V_CMP( V_FMA( eps, T.hi, un.hi ),
+                              V_MUL( delta, S.hi ), _CMP_LE_OQ );
+                canc = V_CMP( V_MUL( eps, T.hi ), V_MUL( delta, S.hi ),
+                              _CMP_GE_OQ );
+                dvg = J->beta<1 ? V_CMP( un.hi, u.hi, _CMP_GT_OQ ) : 0;
+                r = dd_div( S, (vdd){ V_SET1( J->beta ), zero } );
+                isig = V_SUB( zero, isig );
+            } else {
+                vdd s = dd_mul( u, dd_bcast( J->trig, i-J->kappa ) );
+                s = (vdd){ V_MUL( isig, s.hi ), V_MUL( isig, s.lo ) };
+                S = dd_add( S, s );
+                T = dd_add( T, dd_abs( s ) );
+                rfac = V_MUL( rfac, V_SET1( J->truncfac ) );
+                Sabs = dd_abs( S ).hi;
+                conv = V_CMP( V_FMA( eps, T.hi, V_MUL( un.hi, rfac ) ),
+                              V_MUL( delta, Sabs ), _CMP_LE_OQ );
+                canc = 0;
+                dvg = J->beta>1 ? V_CMP( V_MUL( un.hi, V_SET1( J->truncfac ) ),
+                                         u.hi, _CMP_GT_OQ ) : 0;
+                r = S;
+                if ( J->alternating )
+                    isig = V_SUB( zero, isig );
+            }
+            unfl = V_CMP( J->hig ? Sabs : S.hi, V_SET1( DBL_MIN ),
+                          _CMP_LT_OQ );
+            // error codes in order of increasing priority
+            ok = conv & ~over &
+                ~V_CMP( Sabs, V_SET1( DD_TINY ), _CMP_LT_OQ );
+            r.hi = V_BLEND( conv, r.hi, V_BLEND( canc, V_SET1( -6. ),
+                            V_BLEND( dvg, V_SET1( -5. ), V_SET1( -7. ) ) ) );
+            r.hi = V_BLEND( V_CMP( Sabs, V_SET1( DD_TINY ), _CMP_LT_OQ ),
+                            V_SET1( KWW_SIMD_REDO ), r.hi );
+            r.hi = V_BLEND( over, V_SET1( -3. ), r.hi );
+            r.lo = V_BLEND( ok, r.lo, zero );
+            fin = run & ( over | conv | canc | dvg | unfl );
+        }
+        u = un;
+        if ( fin ) {
+            res = V_BLEND( fin, r.hi, res );
+            res_lo = V_BLEND( fin, r.lo, res_lo );
+            for ( int l=0; l<WIDTH; ++l )
+                if ( fin>>l & 1 )
+                    L->nterms[l0+l] = i;
+            run &= ~fin;
+        }
+    }
+
+    V_STORE( L->res+l0, res );
+    V_STORE( L->res_lo+l0, res_lo );
+    V_STORE( L->lw+l0, lw );
+    dd_store( L->q, l0, q );
+    dd_store( L->v, l0, v );
+    dd_store( L->u, l0, u );
+    dd_store( L->S, l0, S );
+    dd_store( L->T, l0, T );
+    V_STORE( L->isig+l0, isig );
+    V_STORE( L->rfac+l0, rfac );
+    return run;
+}
+
+int KWW_SERIES_SIMD_NAME( const kww_series_job* J, kww_series_lanes* L,
+                          const int i_end )
+{
+    int nrun = 0;
+    for ( int l0=0; l0<KWW_SERIES_LANES; l0+=WIDTH )
+        nrun += __builtin_popcount( series_simd_vec( J, L, l0, i_end ) );
+    L->i = i_end;
+    return nrun;
+}
+
+#endif // KWW_SERIES_SIMD_NAME
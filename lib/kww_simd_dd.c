@@ -0,0 +1,314 @@
+/* kww_simd_dd.c:
+ *   Vector primitives, and double-double arithmetic with exp and log,
+ *   lane-wise, for AVX2 or AVX-512.
+ *   Not compiled directly, but included from kww_avx2.c and kww_avx512.c,
+ *   which are compiled for different instruction sets, and which set
+ *   KWW_SIMD_WIDTH to 4 or 8 lanes.
+ *
+ * Copyright:
+ *   (C) 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ *
+ * Reference:
+ *   Wuttke, Algorithms 5, 604-628 (2012), doi:10.3390/a5040604
+ */
+
+#ifndef KWW_SIMD_DD_C
+#define KWW_SIMD_DD_C
+
+#include <math.h>
+#include <immintrin.h>
+
+/*****************************************************************************/
+/*  Vector primitives                                                        */
+/*****************************************************************************/
+
+#if KWW_SIMD_WIDTH==8
+
+#define WIDTH 8
+typedef __m512d V;
+typedef __m512i VI;
+#define V_SET1 _mm512_set1_pd
+#define V_LOAD _mm512_loadu_pd
+#define V_STORE _mm512_storeu_pd
+#define V_ADD _mm512_add_pd
+#define V_SUB _mm512_sub_pd
+#define V_MUL _mm512_mul_pd
+#define V_DIV _mm512_div_pd
+#define V_FMA _mm512_fmadd_pd  // a*b+c
+#define V_FMS _mm512_fmsub_pd  // a*b-c
+#define V_ROUND(x) _mm512_roundscale_pd( x, _MM_FROUND_TO_NEAREST_INT )
+// a<b ? x : y
+#define V_SEL_LT(a,b,x,y) \
+    _mm512_mask_blend_pd( _mm512_cmp_pd_mask( a, b, _CMP_LT_OQ ), y, x )
+// comparison, as bit mask of lanes; lanes of m ? x : y
+#define V_CMP(a,b,op) ( (int)_mm512_cmp_pd_mask( a, b, op ) )
+#define V_BLEND(m,x,y) _mm512_mask_blend_pd( (__mmask8)(m), y, x )
+#define V_AS_I _mm512_castpd_si512
+#define I_AS_V _mm512_castsi512_pd
+#define I_SET1 _mm512_set1_epi64
+#define I_AND _mm512_and_si512
+#define I_OR _mm512_or_si512
+#define I_SHL _mm512_slli_epi64
+#define I_SHR _mm512_srli_epi64
+
+#else // AVX2 with FMA
+
+#define WIDTH 4
+typedef __m256d V;
+typedef __m256i VI;
+#define V_SET1 _mm256_set1_pd
+#define V_LOAD _mm256_loadu_pd
+#define V_STORE _mm256_storeu_pd
+#define V_ADD _mm256_add_pd
+#define V_SUB _mm256_sub_pd
+#define V_MUL _mm256_mul_pd
+#define V_DIV _mm256_div_pd
+#define V_FMA _mm256_fmadd_pd
+#define V_FMS _mm256_fmsub_pd
+#define V_ROUND(x) \
+    _mm256_round_pd( x, _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC )
+#define V_SEL_LT(a,b,x,y) \
+    _mm256_blendv_pd( y, x, _mm256_cmp_pd( a, b, _CMP_LT_OQ ) )
+#define V_CMP(a,b,op) _mm256_movemask_pd( _mm256_cmp_pd( a, b, op ) )
+#define V_BLEND(m,x,y) _mm256_blendv_pd( y, x, mask_from_bits( m ) )
+#define V_AS_I _mm256_castpd_si256
+#define I_AS_V _mm256_castsi256_pd
+#define I_SET1 _mm256_set1_epi64x
+#define I_AND _mm256_and_si256
+#define I_OR _mm256_or_si256
+#define I_SHL _mm256_slli_epi64
+#define I_SHR _mm256_srli_epi64
+
+static inline __m256d mask_from_bits( const int m )
+{
+    const __m256i bit = _mm256_setr_epi64x( 1, 2, 4, 8 );
+    return _mm256_castsi256_pd( _mm256_cmpeq_epi64(
+        _mm256_and_si256( _mm256_set1_epi64x( m ), bit ), bit ) );
+}
+
+#endif
+
+#define ALL_LANES ( (1<<WIDTH)-1 )
+
+/*****************************************************************************/
+/*  Double-double arithmetic, lane-wise                                      */
+/*****************************************************************************/
+
+/* Unevaluated sum hi+lo, as in double_double.c */
+typedef struct {
+    V hi;
+    V lo;
+} vdd;
+
+// requires |a|>=|b|
+static inline vdd quick_two_sum( const V a, const V b )
+{
+    const V s = V_ADD( a, b );
+    return (vdd){ s, V_SUB( b, V_SUB( s, a ) ) };
+}
+
+static inline vdd two_sum( const V a, const V b )
+{
+    const V s = V_ADD( a, b );
+    const V bb = V_SUB( s, a );
+    return (vdd){ s, V_ADD( V_SUB( a, V_SUB( s, bb ) ), V_SUB( b, bb ) ) };
+}
+
+static inline vdd two_prod( const V a, const V b )
+{
+    const V p = V_MUL( a, b );
+    return (vdd){ p, V_FMS( a, b, p ) };
+}
+
+static inline vdd dd_add( const vdd a, const vdd b )
+{
+    vdd s = two_sum( a.hi, b.hi );
+    const vdd t = two_sum( a.lo, b.lo );
+    s = quick_two_sum( s.hi, V_ADD( s.lo, t.hi ) );
+    return quick_two_sum( s.hi, V_ADD( s.lo, t.lo ) );
+}
+
+static inline vdd dd_add_d( const vdd a, const V b )
+{
+    const vdd s = two_sum( a.hi, b );
+    return quick_two_sum( s.hi, V_ADD( s.lo, a.lo ) );
+}
+
+static inline vdd dd_neg( const vdd a )
+{
+    const V zero = V_SET1( 0. );
+    return (vdd){ V_SUB( zero, a.hi ), V_SUB( zero, a.lo ) };
+}
+
+static inline vdd dd_mul( const vdd a, const vdd b )
+{
+    vdd p = two_prod( a.hi, b.hi );
+    p.lo = V_FMA( a.hi, b.lo, V_FMA( a.lo, b.hi, p.lo ) );
+    return quick_two_sum( p.hi, p.lo );
+}
+
+static inline vdd dd_mul_d( const vdd a, const V b )
+{
+    vdd p = two_prod( a.hi, b );
+    p.lo = V_FMA( a.lo, b, p.lo );
+    return quick_two_sum( p.hi, p.lo );
+}
+
+// multiplication by a power of 2
+static inline vdd dd_scale( const vdd a, const double f )
+{
+    const V v = V_SET1( f );
+    return (vdd){ V_MUL( a.hi, v ), V_MUL( a.lo, v ) };
+}
+
+static inline vdd dd_div( const vdd a, const vdd b )
+{
+    const V q1 = V_DIV( a.hi, b.hi );
+    const vdd r = dd_add( a, dd_neg( dd_mul_d( b, q1 ) ) );
+    const V q2 = V_DIV( r.hi, b.hi );
+    return quick_two_sum( q1, q2 );
+}
+
+static inline vdd dd_abs( const vdd a )
+{
+    const vdd n = dd_neg( a );
+    const V zero = V_SET1( 0. );
+    return (vdd){ V_SEL_LT( a.hi, zero, n.hi, a.hi ),
+                  V_SEL_LT( a.hi, zero, n.lo, a.lo ) };
+}
+
+/*****************************************************************************/
+/*  Exponential and logarithm, lane-wise                                     */
+/*****************************************************************************/
+
+/* Relative accuracy is about 1e-22, better than the 5.5e-20 of the
+   exact path. */
+
+static const double LN2_HI = 0x1.62e42fefa39efp-1;
+static const double LN2_LO = 0x1.abc9e3b39803fp-56;
+static const double INV6_HI = 0x1.5555555555555p-3;
+static const double INV6_LO = 0x1.5555555555555p-57;
+
+// 2^k for integer valued k in [-1022, 1023]
+static inline V pow2( const V k )
+{
+    const V biased = V_ADD( k, V_SET1( 1023. + 0x1p52 ) );
+    return I_AS_V( I_SHL( V_AS_I( biased ), 52 ) );
+}
+
+// exp(a), or 0 if a < -708
+static inline vdd dd_exp( const vdd a )
+{
+    vdd r;
+    vdd e;
+    V p;
+    const V k = V_ROUND( V_MUL( a.hi, V_SET1( 1/LN2_HI ) ) );
+
+    // a = k*log(2) + r, |r| <= log(2)/2; then scale r by 1/16
+    r = dd_add( a, dd_neg( dd_mul_d( (vdd){ V_SET1( LN2_HI ),
+                                            V_SET1( LN2_LO ) }, k ) ) );
+    r = dd_scale( r, 1./16 );
+
+    // exp(r)-1 = r + r^2/2 + r^3/6 + r^4*p(r), with dd arithmetic where
+    // needed; |r|<0.022, so that truncation after r^11 is harmless
+    p = V_SET1( 1./39916800 );
+    p = V_FMA( p, r.hi, V_SET1( 1./3628800 ) );
+    p = V_FMA( p, r.hi, V_SET1( 1./362880 ) );
+    p = V_FMA( p, r.hi, V_SET1( 1./40320 ) );
+    p = V_FMA( p, r.hi, V_SET1( 1./5040 ) );
+    p = V_FMA( p, r.hi, V_SET1( 1./720 ) );
+    p = V_FMA( p, r.hi, V_SET1( 1./120 ) );
+    p = V_FMA( p, r.hi, V_SET1( 1./24 ) );
+    {
+        const vdd r2 = dd_mul( r, r );
+        const vdd r3 = dd_mul( r2, r );
+        const V r4 = V_MUL( r2.hi, r2.hi );
+        e = dd_mul( r3, (vdd){ V_SET1( INV6_HI ), V_SET1( INV6_LO ) } );
+        e = dd_add_d( e, V_MUL( r4, p ) );
+        e = dd_add( e, dd_scale( r2, .5 ) );
+        e = dd_add( e, r );
+    }
+
+    // undo scaling, using exp(2r)-1 = 2*(exp(r)-1) + (exp(r)-1)^2
+    for ( int i=0; i<4; ++i )
+        e = dd_add( dd_scale( e, 2. ), dd_mul( e, e ) );
+    e = dd_add_d( e, V_SET1( 1. ) );
+
+    // multiply by 2^k; beyond the cutoff, return 0
+    {
+        const V cut = V_SET1( -708. );
+        const V zero = V_SET1( 0. );
+        const V f = pow2( V_SEL_LT( a.hi, cut, zero, k ) );
+        return (vdd){ V_SEL_LT( a.hi, cut, zero, V_MUL( e.hi, f ) ),
+                      V_SEL_LT( a.hi, cut, zero, V_MUL( e.lo, f ) ) };
+    }
+}
+
+// log(x), to about 1e-13, for normal x>0
+static inline V d_log( const V x )
+{
+    const VI bits = V_AS_I( x );
+    const V two52 = V_SET1( 0x1p52 );
+    V e;
+    V m;
+    V s;
+    V z;
+    V p;
+
+    // x = 2^e * m, 1 <= m < 2; then sqrt(1/2) <= m < sqrt(2)
+    e = V_SUB( I_AS_V( I_OR( I_SHR( bits, 52 ), V_AS_I( two52 ) ) ), two52 );
+    e = V_SUB( e, V_SET1( 1023. ) );
+    m = I_AS_V( I_OR( I_AND( bits, I_SET1( 0x000fffffffffffffLL ) ),
+                      I_SET1( 0x3ff0000000000000LL ) ) );
+    e = V_SEL_LT( m, V_SET1( 1.4142135623730951 ), e,
+                  V_ADD( e, V_SET1( 1. ) ) );
+    m = V_SEL_LT( m, V_SET1( 1.4142135623730951 ), m,
+                  V_MUL( m, V_SET1( .5 ) ) );
+
+    // log(m) = 2*atanh(s)
+    s = V_DIV( V_SUB( m, V_SET1( 1. ) ), V_ADD( m, V_SET1( 1. ) ) );
+    z = V_MUL( s, s );
+    p = V_SET1( 2./15 );
+    p = V_FMA( p, z, V_SET1( 2./13 ) );
+    p = V_FMA( p, z, V_SET1( 2./11 ) );
+    p = V_FMA( p, z, V_SET1( 2./9 ) );
+    p = V_FMA( p, z, V_SET1( 2./7 ) );
+    p = V_FMA( p, z, V_SET1( 2./5 ) );
+    p = V_FMA( p, z, V_SET1( 2./3 ) );
+    p = V_FMA( p, z, V_SET1( 2. ) );
+    return V_FMA( e, V_SET1( LN2_HI ), V_MUL( s, p ) );
+}
+
+// log(x) for x>0, refined by one Newton step: y + x*exp(-y) - 1
+static inline vdd dd_log( const vdd x )
+{
+    const V y = d_log( x.hi );
+    const vdd t = dd_mul( x, dd_exp( (vdd){ V_SUB( V_SET1( 0. ), y ),
+                                            V_SET1( 0. ) } ) );
+    return dd_add_d( dd_add_d( t, V_SET1( -1. ) ), y );
+}
+
+#endif // KWW_SIMD_DD_C
@@ -0,0 +1,285 @@
+/* kww_surrogate.c:
+ *   Fast approximate evaluation by piecewise Chebyshev expansions.
+ *
+ * Copyright:
+ *   (C) 2009, 2012, 2023 Joachim Wuttke
+ *
+ * Licence:
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published
+ *   by the Free Software Foundation; either version 3 of the License, or
+ *   (at your option) any later version. Alternative licenses can be
+ *   obtained through written agreement from the author.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but without any warranty; without even the implied warranty of
+ *   merchantability or fitness for a particular purpose.
+ *   See the GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author:
+ *   Joachim Wuttke
+ *   Forschungszentrum Jülich, Germany
+ *   j.wuttke@fz-juelich.de
+ *
+ * Website:
+ *   https://jugit.fz-juelich.de/mlz/kww
+ *
+ * Reference:
+ *   Wuttke, Algorithms 5, 604-628 (2012), doi:10.3390/a5040604
+ */
+
+
+
+#include <stdlib.h>
+#include <math.h>
+#include "kww.h"
+#include "kww_plan.h"
+
+/* In the range where kww_at would resort to numeric integration,
+   log|kww?(w)| is approximated by Chebyshev polynomials in log(w),
+   on segments that are bisected until the requested accuracy is reached.
+   Outside this range, the series expansions are used as usual. */
+
+#define DEG 16            // polynomial degree
+#define NCHECK (DEG+2)    // check points per segment
+#define SEG_WIDTH 4.      // initial segment width in log(w)
+#define MIN_WIDTH 1e-2    // no further bisection below this width
+#define MAX_SEG 1024
+
+#define PI 3.14159265358979323846
+
+struct kww_surrogate {
+    int kind;
+    kww_plan* plan;
+    double err;   // estimated maximum relative error
+    size_t nseg;
+    double* xb;   // nseg+1 segment bounds in log(w)
+    double* c;    // DEG+1 coefficients per segment
+};
+
+typedef struct {
+    double xa, xb;
+    double c[DEG+1];
+} segment;
+
+static int segment_cmp( const void* a, const void* b )
+{
+    const double xa = ((const segment*)a)->xa, xb = ((const segment*)b)->xa;
+    return xa<xb ? -1 : xa>xb;
+}
+
+/* Sum_j c[j] T_j(t), by Clenshaw's recurrence */
+static double chebyshev( const double* c, const double t )
+{
+    double b1 = 0, b2 = 0;
+    for ( int j=DEG; j>0; --j ) {
+        const double b0 = 2*t*b1 - b2 + c[j];
+        b2 = b1;
+        b1 = b0;
+    }
+    return t*b1 - b2 + c[0];
+}
+
+static double node( const int k )
+{
+    return cos( PI*(k+.5)/(DEG+1) );
+}
+
+static double check_point( const int k )
+{
+    return cos( PI*k/(NCHECK-1) );
+}
+
+/* Evaluates log(kww?(exp(x))) at given points of segments seg[0..n-1];
+   returns 0, or an error code. */
+static int log_values( const kww_surrogate* S, const segment* seg,
+                       const size_t n, const int npt, double (*pt)(int),
+                       double* val )
+{
+    const size_t m = n*npt;
+    double* w = malloc( m*sizeof(double) );
+    int ret = KWW_SUCCESS;
+    if ( !w )
+        return KWW_ENOMEM;
+    for ( size_t i=0; i<n; ++i )
+        for ( int k=0; k<npt; ++k )
+            w[i*npt+k] = exp( ( seg[i].xa+seg[i].xb )/2 +
+                              ( seg[i].xb-seg[i].xa )/2*pt( k ) );
+    if      ( S->kind==0 )
+        kwwc_plan_array_e( S->plan, w, m, val, NULL );
+    else if ( S->kind==1 )
+        kwws_plan_array_e( S->plan, w, m, val, NULL );
+    else
+        kwwp_plan_array_e( S->plan, w, m, val, NULL );
+    for ( size_t i=0; i<m; ++i ) {
+        if ( !( val[i]>0 ) ) {
+            ret = -9;
+            break;
+        }
+        val[i] = log( val[i] );
+    }
+    free( w );
+    return ret;
+}
+
+kww_surrogate* kww_surrogate_create( const int kind, const double beta,
+                                     const double tol, double* err )
+{
+    kww_surrogate* S;
+    segment* done = NULL;
+    segment* todo = NULL;
+    segment* next = NULL;
+    double* val = NULL;
+    size_t ndone = 0, ntodo;
+    if ( kind<KWW_C || kind>KWW_P || !( tol>0 ) )
+        return NULL;
+    if ( !( S = calloc( 1, sizeof(kww_surrogate) ) ) )
+        return NULL;
+    S->kind = kind;
+    if ( !( S->plan = kww_plan_create( beta ) ) )
+        goto fail;
+    const double xlo = log( S->plan->lim_low[kind] );
+    const double xhi = log( S->plan->lim_hig[kind] );
+    if ( !( xlo<xhi ) ) { // nothing to tabulate
+        S->xb = malloc( sizeof(double) );
+        if ( !S->xb )
+            goto fail;
+        S->xb[0] = xhi;
+        if ( err )
+            *err = 0;
+        return S;
+    }
+
+    ntodo = (size_t)ceil( ( xhi-xlo )/SEG_WIDTH );
+    done = malloc( MAX_SEG*sizeof(segment) );
+    todo = malloc( MAX_SEG*sizeof(segment) );
+    next = malloc( MAX_SEG*sizeof(segment) );
+    val = malloc( MAX_SEG*NCHECK*sizeof(double) );
+    if ( !done || !todo || !next || !val )
+        goto fail;
+    for ( size_t i=0; i<ntodo; ++i ) {
+        todo[i].xa = xlo + ( xhi-xlo )*i/ntodo;
+        todo[i].xb = i+1==ntodo ? xhi : xlo + ( xhi-xlo )*(i+1)/ntodo;
+    }
+
+    // bisect segments until accuracy is reached
+    while ( ntodo ) {
+        if ( log_values( S, todo, ntodo, DEG+1, node, val ) )
+            goto fail;
+        for ( size_t i=0; i<ntodo; ++i ) {
+            for ( int j=0; j<=DEG; ++j ) {
+                double sum = 0;
+                for ( int k=0; k<=DEG; ++k )
+                    sum += val[i*(DEG+1)+k] * cos( PI*j*(k+.5)/(DEG+1) );
+                todo[i].c[j] = ( j ? 2. : 1. ) * sum / (DEG+1);
+            }
+        }
+        if ( log_values( S, todo, ntodo, NCHECK, check_point, val ) )
+            goto fail;
+        size_t nnext = 0;
+        for ( size_t i=0; i<ntodo; ++i ) {
+            double e = 0;
+            for ( int k=0; k<NCHECK; ++k ) {
+                // relative error of exp(p) equals absolute error of p
+                const double d = fabs( expm1( chebyshev( todo[i].c,
+                                                         check_point( k ) )
+                                              - val[i*NCHECK+k] ) );
+                if ( d>e )
+                    e = d;
+            }
+            // accept, or bisect if there is room for all remaining halves
+            if ( e<=tol || todo[i].xb-todo[i].xa<MIN_WIDTH ||
+                 ndone+nnext+2*(ntodo-i)>MAX_SEG ) {
+                done[ndone++] = todo[i];
+                if ( e>S->err )
+                    S->err = e;
+            } else {
+                const double xm = ( todo[i].xa+todo[i].xb )/2;
+                next[nnext].xa = todo[i].xa;
+                next[nnext++].xb = xm;
+                next[nnext].xa = xm;
+                next[nnext++].xb = todo[i].xb;
+            }
+        }
+        segment* tmp = todo;
+        todo = next;
+        next = tmp;
+        ntodo = nnext;
+    }
+
+    qsort( done, ndone, sizeof(segment), segment_cmp );
+    S->nseg = ndone;
+    S->xb = malloc( (ndone+1)*sizeof(double) );
+    S->c = malloc( ndone*(DEG+1)*sizeof(double) );
+    if ( !S->xb || !S->c )
+        goto fail;
+    for ( size_t i=0; i<ndone; ++i ) {
+        S->xb[i] = done[i].xa;
+        for ( int j=0; j<=DEG; ++j )
+            S->c[i*(DEG+1)+j] = done[i].c[j];
+    }
+    S->xb[ndone] = done[ndone-1].xb;
+    free( done );
+    free( todo );
+    free( next );
+    free( val );
+    if ( err )
+        *err = S->err;
+    return S;
+
+fail:
+    free( done );
+    free( todo );
+    free( next );
+    free( val );
+    kww_surrogate_destroy( S );
+    return NULL;
+}
+
+void kww_surrogate_destroy( kww_surrogate* S )
+{
+    if ( !S )
+        return;
+    kww_plan_destroy( S->plan );
+    free( S->xb );
+    free( S->c );
+    free( S );
+}
+
+double kww_surrogate_err( const kww_surrogate* S )
+{
+    return S->err;
+}
+
+double kww_surrogate_eval( const kww_surrogate* S, const double w )
+{
+    const double x = log( fabs( w ) );
+    double res;
+    if ( S->nseg && x>=S->xb[0] && x<=S->xb[S->nseg] ) {
+        // binary search for the segment
+        size_t lo = 0, hi = S->nseg;
+        while ( hi-lo>1 ) {
+            const size_t mid = ( lo+hi )/2;
+            if ( x<S->xb[mid] )
+                hi = mid;
+            else
+                lo = mid;
+        }
+        const double xa = S->xb[lo], xb = S->xb[lo+1];
+        res = exp( chebyshev( S->c+lo*(DEG+1), ( 2*x-xa-xb )/( xb-xa ) ) );
+        return S->kind>0 && w<0 ? -res : res;
+    }
+    kww_at( S->kind, &res, w, S->plan->beta, S->plan->lim_low[S->kind],
+            S->plan->lim_hig[S->kind], &S->plan->coef, S->plan->delta );
+    return res;
+}
+
+void kww_surrogate_array( const kww_surrogate* S, const double* w,
+                          const size_t n, double* out )
+{
+    for ( size_t i=0; i<n; ++i )
+        out[i] = kww_surrogate_eval( S, w[i] );
+}
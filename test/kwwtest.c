@@ -14,6 +14,7 @@
 #include "kww.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <assert.h>
 #include <float.h>
@@ -44,6 +45,336 @@ void test_one(int* fail, double limit, double a, double b)
 }
 
 
+// compare array and plan calls against scalar calls, which must agree exactly
+void test_array(int* fail, char kind, double beta, int use_plan)
+{
+    enum { n = 41 };
+    double w[n], out[n];
+    for (int i=0; i<n; ++i)
+        w[i] = (i-n/2) * pow(10., (abs(i-n/2)-10)/2.);
+    if (use_plan) {
+        kww_plan* plan = kww_plan_create(beta);
+        assert(plan);
+        if (kind=='c')
+            kwwc_plan_array(plan, w, n, out);
+        else if (kind=='s')
+            kwws_plan_array(plan, w, n, out);
+        else
+            kwwp_plan_array(plan, w, n, out);
+        kww_plan_destroy(plan);
+    } else if (kind=='c')
+        kwwc_array(w, n, beta, out);
+    else if (kind=='s')
+        kwws_array(w, n, beta, out);
+    else
+        kwwp_array(w, n, beta, out);
+    for (int i=0; i<n; ++i) {
+        double expected = kind=='c' ? kwwc(w[i], beta) :
+            kind=='s' ? kwws(w[i], beta) : kwwp(w[i], beta);
+        if (out[i]!=expected) {
+            printf("ERR array test kww%c beta=%g w=%g: found=%g, expected=%g\n",
+                   kind, beta, w[i], out[i], expected);
+            ++(*fail);
+        }
+    }
+}
+
+// in-place array and plan calls, with out==w, must agree exactly with scalar
+// calls; enough points for the block-wise series and integration passes
+void test_inplace(int* fail, char kind, double beta, int use_plan)
+{
+    enum { n = 201 };
+    double w[n], x[n];
+    for (int i=0; i<n; ++i)
+        x[i] = w[i] = (i-n/2) * pow(10., (abs(i-n/2)-50)/10.);
+    if (use_plan) {
+        kww_plan* plan = kww_plan_create(beta);
+        assert(plan);
+        if (kind=='c')
+            kwwc_plan_array(plan, x, n, x);
+        else if (kind=='s')
+            kwws_plan_array(plan, x, n, x);
+        else
+            kwwp_plan_array(plan, x, n, x);
+        kww_plan_destroy(plan);
+    } else if (kind=='c')
+        kwwc_array(x, n, beta, x);
+    else if (kind=='s')
+        kwws_array(x, n, beta, x);
+    else
+        kwwp_array(x, n, beta, x);
+    for (int i=0; i<n; ++i) {
+        double expected = kind=='c' ? kwwc(w[i], beta) :
+            kind=='s' ? kwws(w[i], beta) : kwwp(w[i], beta);
+        if (x[i]!=expected) {
+            printf("ERR in-place test kww%c beta=%g w=%g: found=%g,"
+                   " expected=%g\n", kind, beta, w[i], x[i], expected);
+            ++(*fail);
+        }
+    }
+}
+
+// same for beta>1.9, where kwwc fails for some w around 10..100, so that
+// failed points are redone after the parallel pass; kwwc and the complex
+// call, with re or im in place
+void test_inplace_redo(int* fail, double beta, int use_plan)
+{
+    enum { n = 100 };
+    double w[n], x[n], y[n], re, im;
+    kww_plan* plan = use_plan ? kww_plan_create(beta) : NULL;
+    assert(plan || !use_plan);
+    for (int i=0; i<n; ++i)
+        w[i] = pow(10., -1+.03*i);
+    for (int m=0; m<3; ++m) {
+        double* out = m==2 ? y : x; // kwwc, or complex with re or im in place
+        for (int i=0; i<n; ++i)
+            x[i] = w[i];
+        if (m==0 && plan)
+            kwwc_plan_array(plan, x, n, x);
+        else if (m==0)
+            kwwc_array(x, n, beta, x);
+        else if (plan)
+            kww_complex_plan_array(plan, x, n, m==1 ? x : y, m==1 ? y : x);
+        else
+            kww_complex_array(x, n, beta, m==1 ? x : y, m==1 ? y : x);
+        for (int i=0; i<n; ++i) {
+            kww_complex(w[i], beta, &re, &im);
+            if (out[i]!=re || (m && (m==1 ? y : x)[i]!=im)) {
+                printf("ERR in-place redo test %s beta=%g w=%g: found=%g,"
+                       " expected=%g\n", m ? "complex" : "kwwc", beta, w[i],
+                       out[i], re);
+                ++(*fail);
+            }
+        }
+    }
+    kww_plan_destroy(plan);
+}
+
+// complex evaluation must agree exactly with separate kwwc, kwws
+void test_complex(int* fail, double beta)
+{
+    enum { n = 81 };
+    double w[n], re[n], im[n], re1, im1;
+    for (int i=0; i<n; ++i)
+        w[i] = (i-n/2) * pow(10., (abs(i-n/2)-20)/4.);
+    kww_complex_array(w, n, beta, re, im);
+    for (int i=0; i<n; ++i) {
+        kww_complex(w[i], beta, &re1, &im1);
+        if (re[i]!=kwwc(w[i], beta) || im[i]!=kwws(w[i], beta) ||
+            re1!=re[i] || im1!=im[i]) {
+            printf("ERR complex test beta=%g w=%g: found=%g%+gi,"
+                   " expected=%g%+gi\n", beta, w[i], re[i], im[i],
+                   kwwc(w[i], beta), kwws(w[i], beta));
+            ++(*fail);
+        }
+    }
+}
+
+// fused kwws, kwwp must agree exactly with separate calls
+void test_sp(int* fail, double beta)
+{
+    enum { n = 81 };
+    double w[n], s[n], p[n], s1, p1;
+    for (int i=0; i<n; ++i)
+        w[i] = (i-n/2) * pow(10., (abs(i-n/2)-20)/4.);
+    if (kwwsp_array_e(w, n, beta, s, p, NULL)) {
+        printf("ERR kwwsp_array_e failed for beta=%g\n", beta);
+        ++(*fail);
+    }
+    for (int i=0; i<n; ++i) {
+        kwwsp(w[i], beta, &s1, &p1);
+        if (s[i]!=kwws(w[i], beta) || p[i]!=kwwp(w[i], beta) ||
+            s1!=s[i] || p1!=p[i]) {
+            printf("ERR kwwsp test beta=%g w=%g: found=%g,%g,"
+                   " expected=%g,%g\n", beta, w[i], s[i], p[i],
+                   kwws(w[i], beta), kwwp(w[i], beta));
+            ++(*fail);
+        }
+    }
+}
+
+// kwwc_deriv: value must agree exactly with kwwc, derivatives with
+// central differences, relative to the larger of their magnitude and kwwc
+void test_deriv(int* fail, double beta)
+{
+    enum { n = 81 };
+    const double h = 1e-5;
+    double w[n], res[n], dw[n], db[n], x[n], dwx[n], dbx[n], r1, dw1, db1;
+    for (int i=0; i<n; ++i)
+        x[i] = w[i] = (i-n/2) * pow(10., (abs(i-n/2)-20)/4.);
+    if (kwwc_deriv_array_e(w, n, beta, res, dw, db, NULL)) {
+        printf("ERR kwwc_deriv_array_e failed for beta=%g\n", beta);
+        ++(*fail);
+    }
+    // in place, res==w, must give the same
+    kwwc_deriv_array_e(x, n, beta, x, dwx, dbx, NULL);
+    for (int i=0; i<n; ++i) {
+        if (x[i]!=res[i] || dwx[i]!=dw[i] || dbx[i]!=db[i]) {
+            printf("ERR kwwc_deriv in-place test beta=%g w=%g\n", beta, w[i]);
+            ++(*fail);
+        }
+    }
+    for (int i=0; i<n; ++i) {
+        const double c = kwwc(w[i], beta);
+        const double fw = beta==2 ? -w[i]/2*c :
+            (kwwc(w[i]*(1+h), beta)-kwwc(w[i]*(1-h), beta))/(2*h*w[i]);
+        const double fb = beta==2 ? db[i] :
+            (kwwc(w[i], beta+h)-kwwc(w[i], beta-h))/(2*h);
+        kwwc_deriv_e(w[i], beta, &r1, &dw1, &db1);
+        if (res[i]!=c || r1!=c || (w[i] && fabs(w[i]*(dw[i]-fw)) >
+                                     1e-6*fmax(fabs(w[i]*fw), c)) ||
+            fabs(db[i]-fb) > 1e-6*fmax(fabs(fb), c) ||
+            fabs(dw1-dw[i]) > 1e-12*fmax(fabs(dw[i]), c/fabs(w[i])) ||
+            fabs(db1-db[i]) > 1e-12*fmax(fabs(db[i]), c)) {
+            printf("ERR kwwc_deriv test beta=%g w=%g: found=%g,%g,%g,"
+                   " expected=%g,%g,%g\n", beta, w[i], res[i], dw[i], db[i],
+                   c, fw, fb);
+            ++(*fail);
+        }
+    }
+}
+
+// grid must agree exactly with scalar calls, and flag beta out of range
+void test_grid(int* fail, int kind, int nw)
+{
+    enum { nb = 5 };
+    const double beta[nb] = { .12, .5, 1., 1.7, 2.5 };
+    double w[81], out[81*nb];
+    for (int i=0; i<nw; ++i)
+        w[i] = (i-nw/2) * pow(10., (abs(i-nw/2)-nw/4)/4.);
+    if (kww_grid(kind, w, nw, beta, nb, out) != nw) {
+        printf("ERR kww_grid reported wrong number of failures\n");
+        ++(*fail);
+    }
+    for (int j=0; j<nb; ++j) {
+        for (int i=0; i<nw; ++i) {
+            double found = out[j*nw+i];
+            double expected = beta[j]>2 ? NAN : kind==KWW_C ?
+                kwwc(w[i], beta[j]) : kind==KWW_S ?
+                kwws(w[i], beta[j]) : kwwp(w[i], beta[j]);
+            if (found!=expected && !(isnan(found) && isnan(expected))) {
+                printf("ERR grid test kind=%i beta=%g w=%g: found=%g,"
+                       " expected=%g\n", kind, beta[j], w[i], found, expected);
+                ++(*fail);
+            }
+        }
+    }
+}
+
+// surrogate must attain the requested accuracy, and be exact outside the table
+void test_surrogate(int* fail, int kind, double beta)
+{
+    double err;
+    kww_surrogate* sur = kww_surrogate_create(kind, beta, 1e-10, &err);
+    if (!sur || err>1e-10) {
+        printf("ERR surrogate kind=%i beta=%g not built, or err=%g\n",
+               kind, beta, sur ? err : NAN);
+        ++(*fail);
+        kww_surrogate_destroy(sur);
+        return;
+    }
+    for (int i=0; i<100; ++i) {
+        double w = (i%2 ? -1 : 1) * pow(10., -8 + i*.1);
+        double found = kww_surrogate_eval(sur, w);
+        double expected = kind==KWW_C ? kwwc(w, beta) :
+            kind==KWW_S ? kwws(w, beta) : kwwp(w, beta);
+        if (!(fabs(found/expected-1)<2e-10)) {
+            printf("ERR surrogate kind=%i beta=%g w=%g: found=%.17g,"
+                   " expected=%.17g\n", kind, beta, w, found, expected);
+            ++(*fail);
+        }
+    }
+    kww_surrogate_destroy(sur);
+}
+
+// plan with relaxed tolerance must attain it, and reject tol out of range
+void test_tol(int* fail, double beta, double tol)
+{
+    kww_plan* plan = kww_plan_create(beta);
+    if (kww_plan_set_tol(plan, tol) || kww_plan_tol(plan) != tol ||
+        kww_plan_set_tol(plan, KWW_TOL_MIN/2) != KWW_EDOM ||
+        kww_plan_set_tol(plan, KWW_TOL_MAX*2) != KWW_EDOM ||
+        kww_plan_tol(plan) != tol) {
+        printf("ERR kww_plan_set_tol beta=%g tol=%g\n", beta, tol);
+        ++(*fail);
+    }
+    for (int i=0; i<120; ++i) {
+        double w = pow(10., -4 + i*.07);
+        double found[3] = { kwwc_plan(plan, w), kwws_plan(plan, w),
+                            kwwp_plan(plan, w) };
+        double expected[3] = { kwwc(w, beta), kwws(w, beta), kwwp(w, beta) };
+        for (int k=0; k<3; ++k) {
+            if (!(fabs(found[k]/expected[k]-1)<=tol)) {
+                printf("ERR tol=%g kind=%i beta=%g w=%g: found=%.17g,"
+                       " expected=%.17g\n", tol, k, beta, w, found[k],
+                       expected[k]);
+                ++(*fail);
+            }
+        }
+    }
+    kww_plan_destroy(plan);
+}
+
+// calls with status code must not terminate, and must flag invalid input
+void test_status(int* fail)
+{
+    double res, w[3] = { .5, NAN, -2. }, out[3];
+    int status[3];
+    if (kwwc_e(1., 2.5, &res) != KWW_EDOM || !isnan(res)) {
+        printf("ERR kwwc_e did not flag beta out of range\n");
+        ++(*fail);
+    }
+    if (kwws_e(.3, .7, &res) != KWW_SUCCESS || res != kwws(.3, .7)) {
+        printf("ERR kwws_e disagrees with kwws\n");
+        ++(*fail);
+    }
+    if (kwwp_array_e(w, 3, .8, out, status) != 1 || status[0] || status[2] ||
+        status[1] != KWW_EDOM || !isnan(out[1]) || out[2] != kwwp(-2., .8)) {
+        printf("ERR kwwp_array_e did not flag NaN argument\n");
+        ++(*fail);
+    }
+    if (kwwc_array_e(w, 3, .05, out, NULL) != 3) {
+        printf("ERR kwwc_array_e did not flag beta out of range\n");
+        ++(*fail);
+    }
+}
+
+// tables built up front, released, and built again on demand must give
+// the same results
+void test_lifecycle(int* fail)
+{
+    const double beta[3] = { .2, .9, 1.8 };
+    const kww_init_options bad[3] = { { .5, .3, 0 }, { .05, 1., 0 },
+                                      { .5, 1., 13 } };
+    const kww_init_options some = { .8, 1.2, 3 };
+    double before[3][2];
+    for (int j=0; j<3; ++j) {
+        before[j][0] = kwwc(1., beta[j]);
+        before[j][1] = kwws(1., beta[j]);
+    }
+    for (int k=0; k<3; ++k) {
+        if (kww_init(&bad[k]) != KWW_EDOM) {
+            printf("ERR kww_init accepted invalid options %i\n", k);
+            ++(*fail);
+        }
+    }
+    for (int pass=0; pass<3; ++pass) {
+        kww_finalize();
+        if (pass && kww_init(pass==1 ? NULL : &some) != KWW_SUCCESS) {
+            printf("ERR kww_init failed in pass %i\n", pass);
+            ++(*fail);
+        }
+        for (int j=0; j<3; ++j) {
+            if (kwwc(1., beta[j]) != before[j][0] ||
+                kwws(1., beta[j]) != before[j][1]) {
+                printf("ERR pass %i beta=%g: results changed after"
+                       " kww_finalize\n", pass, beta[j]);
+                ++(*fail);
+            }
+        }
+    }
+}
+
 /******************************************************************************/
 /*  Main: test sequence                                                       */
 /******************************************************************************/
@@ -82,6 +413,55 @@ int main(void) {
     test_one(&fail, 1e-14, kwwp(5e-3, .459), 0.01185130685163975767); // mode=2
     test_one(&fail, 5e-12, kwwp(2e-2, .459), 0.04668285680895551543); // mode=1
 
+    for (int use_plan=0; use_plan<2; ++use_plan) {
+        test_array(&fail, 'c', .314, use_plan);
+        test_array(&fail, 'c', 1.5, use_plan);
+        test_array(&fail, 's', .623, use_plan);
+        test_array(&fail, 's', 1.2, use_plan);
+        test_array(&fail, 'p', .459, use_plan);
+        test_array(&fail, 'p', 1.7, use_plan);
+        test_inplace(&fail, 'c', .5, use_plan);
+        test_inplace(&fail, 'c', .8, use_plan);
+        test_inplace(&fail, 's', 1.2, use_plan);
+        test_inplace(&fail, 'p', .459, use_plan);
+        test_inplace_redo(&fail, 1.995, use_plan);
+    }
+    test_complex(&fail, .12);
+    test_complex(&fail, .314);
+    test_complex(&fail, .623);
+    test_complex(&fail, 1.);
+    test_complex(&fail, 1.5);
+    test_complex(&fail, 1.85);
+    test_complex(&fail, 2.);
+    test_sp(&fail, .12);
+    test_sp(&fail, .459);
+    test_sp(&fail, 1.2);
+    test_sp(&fail, 1.9);
+    test_deriv(&fail, .12);
+    test_deriv(&fail, .623);
+    test_deriv(&fail, 1.5);
+    test_deriv(&fail, 1.85);
+    test_deriv(&fail, 2.);
+    for (int kind=KWW_C; kind<=KWW_P; ++kind) {
+        test_grid(&fail, kind, 9);
+        test_grid(&fail, kind, 81);
+    }
+    test_surrogate(&fail, KWW_C, .3);
+    test_surrogate(&fail, KWW_C, 1.85);
+    test_surrogate(&fail, KWW_S, .77);
+    test_surrogate(&fail, KWW_P, 1.5);
+    test_tol(&fail, .3, 1e-12);
+    test_tol(&fail, .8, 1e-6);
+    test_tol(&fail, 1.7, 1e-3);
+    test_status(&fail);
+    test_lifecycle(&fail);
+    if (kww_plan_create(2.5) || kww_plan_create(.05)) {
+        printf("ERR kww_plan_create accepted beta out of range\n");
+        ++fail;
+    }
+
+    kww_finalize();
+
     printf("\n");
     if (fail) {
         printf("IN TOTAL, FAILURE IN %i TESTS\n", fail);
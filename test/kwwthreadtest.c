@@ -0,0 +1,98 @@
+/* kwwthreadtest.c
+ *
+ * Copyright (C) 2009-2019 Joachim Wuttke
+ *
+ * Licence: GNU General Public License, version 3 or later
+ *
+ * Author:
+ *   Joachim Wuttke, Forschungszentrum Jülich, Germany <j.wuttke@fz-juelich.de>
+ *
+ * Purpose:
+ *   Test whether concurrent calls, starting with cold kww_mid tables,
+ *   give the same results as sequential calls.
+ */
+
+#include "kww.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+
+KWW_IMPORT extern _Thread_local int kww_algorithm;
+
+#define NTHREADS 4
+#define NB 12
+#define NW 40
+
+static double results[NTHREADS][NB][NW][3];
+static int algo_errors[NTHREADS];
+
+static double beta_of(int ib) { return 0.12 + 1.7 * ib / (NB-1.); }
+static double omega_of(int iw) { return pow(10., -3 + 5. * iw / (NW-1.)); }
+
+static void* worker(void* arg)
+{
+    int it = *(int*)arg;
+    for (int ib=0; ib<NB; ++ib) {
+        // each thread visits the beta values in a different order
+        int jb = (ib + it*NB/NTHREADS) % NB;
+        for (int iw=0; iw<NW; ++iw) {
+            double b = beta_of(jb), w = omega_of(iw);
+            results[it][jb][iw][0] = kwwc(w, b);
+            results[it][jb][iw][1] = kwws(w, b);
+            results[it][jb][iw][2] = kwwp(w, b);
+        }
+        // diagnostics must refer to this thread's last call
+        kwwc(1e-30, beta_of(jb));
+        if (kww_algorithm != 1)
+            ++algo_errors[it];
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t threads[NTHREADS];
+    int ids[NTHREADS];
+    int fail = 0;
+
+    for (int it=0; it<NTHREADS; ++it) {
+        ids[it] = it;
+        pthread_create(&threads[it], NULL, worker, &ids[it]);
+    }
+    for (int it=0; it<NTHREADS; ++it)
+        pthread_join(threads[it], NULL);
+
+    for (int ib=0; ib<NB; ++ib) {
+        for (int iw=0; iw<NW; ++iw) {
+            double b = beta_of(ib), w = omega_of(iw);
+            double expected[3] = { kwwc(w, b), kwws(w, b), kwwp(w, b) };
+            for (int it=0; it<NTHREADS; ++it) {
+                for (int k=0; k<3; ++k) {
+                    if (results[it][ib][iw][k] != expected[k]) {
+                        printf("ERR thread %i, kww%c(%g, %g): found=%g,"
+                               " expected=%g\n", it, "csp"[k], w, b,
+                               results[it][ib][iw][k], expected[k]);
+                        ++fail;
+                    }
+                }
+            }
+        }
+    }
+    for (int it=0; it<NTHREADS; ++it) {
+        if (algo_errors[it]) {
+            printf("ERR thread %i: kww_algorithm overwritten %i times\n",
+                   it, algo_errors[it]);
+            ++fail;
+        }
+    }
+
+    printf("\n");
+    if (fail) {
+        printf("IN TOTAL, FAILURE IN %i TESTS\n", fail);
+        return 1;
+    } else {
+        printf("OVERALL SUCCESS\n");
+        return 0;
+    }
+}